@@ -0,0 +1,83 @@
+// Compares keyword recognition through the generated perfect hash table against the prefix switch
+// the scanner used before it.
+
+#include "scanner-priv.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 2000000
+
+static const char *identifiers[] = {
+    "executable", "sources",      "include_directories", "link_libraries", "name",   "print",
+    "include",    "include_once", "local",               "true",           "false",  "nil",
+    "a",          "my_var",       "inc",                 "include_onc",    "locals", "printf",
+    "trueish",    "nil_value",    "src",                 "get_properties",
+};
+
+static const int identifier_count = sizeof(identifiers) / sizeof(identifiers[0]);
+
+static vmake_token_type check_keyword(const char *start, int length, int offset, int rest_length,
+                                      const char *rest, vmake_token_type type) {
+  if (length == offset + rest_length && memcmp(start + offset, rest, rest_length) == 0)
+    return type;
+
+  return TOKEN_IDENTIFIER;
+}
+
+static vmake_token_type switch_keyword_type(const char *start, int length) {
+  switch (*start) {
+  case 'f':
+    return check_keyword(start, length, 1, 4, "alse", TOKEN_FALSE);
+  case 'i':
+    if (length > 7)
+      return check_keyword(start, length, 1, 11, "nclude_once", TOKEN_INCLUDE_ONCE);
+    return check_keyword(start, length, 1, 6, "nclude", TOKEN_INCLUDE);
+  case 'l':
+    return check_keyword(start, length, 1, 4, "ocal", TOKEN_LOCAL);
+  case 'n':
+    return check_keyword(start, length, 1, 2, "il", TOKEN_NIL);
+  case 'p':
+    return check_keyword(start, length, 1, 4, "rint", TOKEN_PRINT);
+  case 't':
+    return check_keyword(start, length, 1, 3, "rue", TOKEN_TRUE);
+  }
+
+  return TOKEN_IDENTIFIER;
+}
+
+static double elapsed_ns(struct timespec start, struct timespec end) {
+  return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+static double bench(const char *name, vmake_token_type (*fn)(const char *, int), int *lengths) {
+  struct timespec start, end;
+  // Accumulating the results keeps the compiler from optimizing the calls away.
+  volatile int sink = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < ITERATIONS; i++) {
+    for (int j = 0; j < identifier_count; j++)
+      sink += fn(identifiers[j], lengths[j]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = elapsed_ns(start, end) / ((double)ITERATIONS * identifier_count);
+  printf("%-12s %6.2f ns/identifier\n", name, ns);
+  return ns;
+}
+
+int main(void) {
+  int lengths[sizeof(identifiers) / sizeof(identifiers[0])];
+  for (int i = 0; i < identifier_count; i++) {
+    lengths[i] = strlen(identifiers[i]);
+    if (switch_keyword_type(identifiers[i], lengths[i]) !=
+        vmake_keyword_type(identifiers[i], lengths[i])) {
+      fprintf(stderr, "Keyword tables disagree on '%s'\n", identifiers[i]);
+      return 1;
+    }
+  }
+
+  bench("switch", switch_keyword_type, lengths);
+  bench("perfect hash", vmake_keyword_type, lengths);
+  return 0;
+}
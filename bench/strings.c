@@ -0,0 +1,107 @@
+// Measures interning a million distinct paths, the kind of strings large configurations are made
+// of. Hashing is compared against the byte-at-a-time FNV-1a hash strings used to be interned with.
+
+#include "hash.h"
+#include "interner.h"
+#include "object.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PATH_COUNT 1000000
+#define ROUNDS 5
+
+static double elapsed_ns(struct timespec start, struct timespec end) {
+  return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+static uint32_t fnv1a(const char *chars, int length) {
+  uint32_t hash = 2166136261;
+  for (int i = 0; i < length; i++) {
+    hash = hash ^ (uint8_t)chars[i];
+    hash = hash * 16777619;
+  }
+  return hash;
+}
+
+static void report(const char *name, struct timespec start, struct timespec end, int rounds) {
+  printf("%-10s %6.2f ns/string\n", name, elapsed_ns(start, end) / ((double)rounds * PATH_COUNT));
+}
+
+int main(void) {
+  char **paths = malloc(sizeof(char *) * PATH_COUNT);
+  int *lengths = malloc(sizeof(int) * PATH_COUNT);
+  for (int i = 0; i < PATH_COUNT; i++) {
+    char buf[128];
+    lengths[i] = snprintf(buf, sizeof(buf), "/home/user/project/src/module%d/component/file%d.c",
+                          i / 100, i);
+    paths[i] = strdup(buf);
+  }
+
+  struct timespec start, end;
+  // Accumulating the results keeps the compiler from optimizing the loops away.
+  volatile uint32_t sink = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int i = 0; i < PATH_COUNT; i++) {
+      sink += fnv1a(paths[i], lengths[i]);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  report("fnv1a", start, end, ROUNDS);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int i = 0; i < PATH_COUNT; i++) {
+      sink += vmake_hash_chars(paths[i], lengths[i]);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  report("wyhash", start, end, ROUNDS);
+
+  // Only the interner is measured, so the strings are allocated up front, like the scanner hashes
+  // tokens up front.
+  vmake_obj_string *strings = calloc(PATH_COUNT, sizeof(vmake_obj_string));
+  for (int i = 0; i < PATH_COUNT; i++) {
+    strings[i].length = lengths[i];
+    strings[i].hash = vmake_hash_chars(paths[i], lengths[i]);
+  }
+
+  vmake_interner interner;
+  vmake_interner_init(&interner);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < PATH_COUNT; i++) {
+    vmake_obj_string *str = &strings[i];
+    if (vmake_interner_find(&interner, paths[i], str->length, str->hash) == NULL) {
+      str->chars = vmake_interner_copy_chars(&interner, paths[i], str->length);
+      vmake_interner_add(&interner, str);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  report("intern", start, end, 1);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int i = 0; i < PATH_COUNT; i++) {
+      sink += vmake_interner_find(&interner, paths[i], lengths[i], strings[i].hash)->length;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  report("lookup", start, end, ROUNDS);
+
+  size_t table_bytes = sizeof(vmake_interner_slot) * interner.capacity +
+                       sizeof(vmake_obj_string *) * interner.string_capacity;
+  size_t char_bytes = interner.page_bytes;
+  printf("%-10s %6.2f bytes/string\n", "table", (double)table_bytes / PATH_COUNT);
+  printf("%-10s %6.2f bytes/string\n", "chars", (double)char_bytes / PATH_COUNT);
+
+  vmake_interner_free(&interner);
+  free(strings);
+  for (int i = 0; i < PATH_COUNT; i++) {
+    free(paths[i]);
+  }
+  free(lengths);
+  free(paths);
+  return 0;
+}
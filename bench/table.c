@@ -0,0 +1,108 @@
+// Measures tables under the interleaved puts, removes and lookups that globals and instance
+// properties see, and checks along the way that the pointers vmake_table_get hands out stay valid
+// while the table grows and reuses removed entries. Exits with an error if they don't.
+
+#include "object.h"
+#include "table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define KEY_COUNT 200000
+#define OPERATION_COUNT 2000000
+// Every this many operations, every key is looked up again.
+#define CHECK_INTERVAL 100000
+
+// Values are printed with this, which needs the whole object model. The keys and values here are
+// all numbers, so it's never called.
+char *vmake_obj_to_string(vmake_obj *obj) {
+  (void)obj;
+  abort();
+}
+
+static double elapsed_ns(struct timespec start, struct timespec end) {
+  return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+// Checks that every key the table should hold is found at the pointer it was inserted at, with the
+// value it was last given, and that no other key is found.
+static bool check(vmake_table *table, vmake_value **pointers, double *values) {
+  for (int key = 0; key < KEY_COUNT; key++) {
+    vmake_value *value;
+    bool found = vmake_table_get(table, vmake_value_number(key), &value);
+    if (found != (pointers[key] != NULL)) {
+      fprintf(stderr, "key %d: expected found=%d\n", key, pointers[key] != NULL);
+      return false;
+    }
+    if (!found)
+      continue;
+    if (value != pointers[key] || vmake_value_as_number(*value) != values[key]) {
+      fprintf(stderr, "key %d: value moved or changed\n", key);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(void) {
+  // The pointer returned when each key was last inserted, or NULL if it's not in the table.
+  vmake_value **pointers = calloc(KEY_COUNT, sizeof(vmake_value *));
+  double *values = malloc(sizeof(double) * KEY_COUNT);
+  vmake_table table;
+  vmake_table_init(&table);
+  srand(1);
+
+  struct timespec start, end;
+  double checked_ns = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < OPERATION_COUNT; i++) {
+    int key = rand() % KEY_COUNT;
+    vmake_value key_value = vmake_value_number(key);
+    // Half the operations are puts at first, so that the table grows, and then there are as many
+    // removes as puts.
+    int op = rand() % (i < OPERATION_COUNT / 4 ? 4 : 3);
+    if (op == 0) {
+      vmake_value *value = NULL;
+      if (vmake_table_get(&table, key_value, &value) != (pointers[key] != NULL) ||
+          (pointers[key] != NULL && value != pointers[key])) {
+        fprintf(stderr, "key %d: lookup disagrees with the table's contents\n", key);
+        return 1;
+      }
+    } else if (op == 1) {
+      if (vmake_table_remove(&table, key_value) != (pointers[key] != NULL)) {
+        fprintf(stderr, "key %d: remove disagrees with the table's contents\n", key);
+        return 1;
+      }
+      pointers[key] = NULL;
+    } else {
+      vmake_value *inserted;
+      values[key] = i;
+      vmake_table_put_cpy_ret(&table, key_value, vmake_value_number(i), &inserted);
+      if (pointers[key] != NULL && inserted != pointers[key]) {
+        fprintf(stderr, "key %d: putting an existing key moved its value\n", key);
+        return 1;
+      }
+      pointers[key] = inserted;
+    }
+
+    if ((i + 1) % CHECK_INTERVAL == 0) {
+      struct timespec check_start, check_end;
+      clock_gettime(CLOCK_MONOTONIC, &check_start);
+      if (!check(&table, pointers, values))
+        return 1;
+      clock_gettime(CLOCK_MONOTONIC, &check_end);
+      checked_ns += elapsed_ns(check_start, check_end);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = (elapsed_ns(start, end) - checked_ns) / OPERATION_COUNT;
+  printf("%-10s %6.2f ns/operation\n", "mixed", ns);
+  printf("%-10s %6d entries, %d slots\n", "final", table.count, table.capacity);
+  printf("pointers stayed valid\n");
+
+  vmake_table_free(&table);
+  free(values);
+  free(pointers);
+  return 0;
+}
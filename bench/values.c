@@ -0,0 +1,104 @@
+// Measures the value representation on the kind of work large configurations do with arrays:
+// filling them, copying them into other arrays, and scanning them. It is built twice, once with
+// tagged union values and once with NaN-boxed values, so that running both compares them.
+
+#include "array.h"
+#include "object.h"
+#include <stdio.h>
+#include <time.h>
+
+#define VALUE_COUNT 1000000
+#define ROUNDS 20
+#define OBJECT_COUNT 64
+
+static vmake_obj objects[OBJECT_COUNT];
+
+static double elapsed_ns(struct timespec start, struct timespec end) {
+  return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+// Mostly objects, like the paths of a sources list, with some numbers, booleans and nils.
+static vmake_value make_value(int i) {
+  switch (i % 8) {
+  case 0:
+    return vmake_value_number(i);
+  case 1:
+    return vmake_value_bool(i % 3 == 0);
+  case 2:
+    return vmake_value_nil();
+  default:
+    return vmake_value_obj(&objects[i % OBJECT_COUNT]);
+  }
+}
+
+static void report(const char *name, struct timespec start, struct timespec end) {
+  double ns = elapsed_ns(start, end) / ((double)ROUNDS * VALUE_COUNT);
+  printf("%-10s %6.2f ns/value\n", name, ns);
+}
+
+int main(void) {
+#ifdef VMAKE_NAN_BOXING
+  printf("NaN-boxed values, %zu bytes each\n", sizeof(vmake_value));
+#else
+  printf("Tagged union values, %zu bytes each\n", sizeof(vmake_value));
+#endif
+
+  struct timespec start, end;
+  // Accumulating the results keeps the compiler from optimizing the loops away.
+  volatile double sink = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  vmake_value_array arr;
+  for (int round = 0; round < ROUNDS; round++) {
+    vmake_value_array_new(&arr);
+    for (int i = 0; i < VALUE_COUNT; i++) {
+      vmake_value_array_push(&arr, make_value(i));
+    }
+    if (round != ROUNDS - 1)
+      vmake_value_array_free(&arr);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  report("fill", start, end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int round = 0; round < ROUNDS; round++) {
+    vmake_value_array copy;
+    vmake_value_array_new(&copy);
+    vmake_value_array_reserve(&copy, arr.size);
+    for (int i = 0; i < arr.size; i++) {
+      vmake_value_array_push(&copy, arr.values[i]);
+    }
+    sink += copy.size;
+    vmake_value_array_free(&copy);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  report("copy", start, end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int round = 0; round < ROUNDS; round++) {
+    double total = 0;
+    for (int i = 0; i < arr.size; i++) {
+      vmake_value val = arr.values[i];
+      if (vmake_value_is_number(val))
+        total += vmake_value_as_number(val);
+      else if (vmake_value_is_obj(val))
+        total += vmake_value_as_obj(val) == &objects[0];
+    }
+    sink += total;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  report("scan", start, end);
+
+  // Looking for a value that isn't there compares it with every element.
+  vmake_obj missing;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int round = 0; round < ROUNDS; round++) {
+    sink += vmake_value_array_contains(&arr, vmake_value_obj(&missing));
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  report("contains", start, end);
+
+  printf("%-10s %6.2f MiB\n", "footprint", arr.capacity * sizeof(vmake_value) / 1048576.0);
+  vmake_value_array_free(&arr);
+  return 0;
+}
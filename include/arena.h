@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+
+// The size of the regions small allocations are carved out of.
+#define VMAKE_ARENA_REGION_SIZE (64 * 1024)
+// Every allocation is rounded up to a multiple of this, which is also its alignment.
+#define VMAKE_ARENA_GRANULE 16
+// Allocations of up to VMAKE_ARENA_CLASS_COUNT granules are small, and bigger ones are large.
+#define VMAKE_ARENA_CLASS_COUNT 16
+#define VMAKE_ARENA_MAX_SMALL (VMAKE_ARENA_GRANULE * VMAKE_ARENA_CLASS_COUNT)
+
+typedef struct vmake_arena_region vmake_arena_region;
+typedef struct vmake_arena_large vmake_arena_large;
+typedef struct vmake_arena_slot vmake_arena_slot;
+
+// Owns the memory of the objects of a state. Small allocations are bumped out of big regions, and
+// returned to a free list for their size class when released, so that later allocations of the
+// same size reuse them. Large allocations get their own block. Everything is freed at once with
+// vmake_arena_free, so objects don't need to be freed one by one.
+//
+// Arenas aren't thread-safe, so only the thread running the state may allocate from them.
+typedef struct vmake_arena {
+  vmake_arena_region *regions;
+  // The unused part of the newest region.
+  char *next;
+  char *end;
+  vmake_arena_slot *free_lists[VMAKE_ARENA_CLASS_COUNT];
+  vmake_arena_large *large;
+  // The number of bytes handed out and not released, rounded up to size classes, plus the bytes
+  // accounted for with vmake_arena_account.
+  size_t allocated;
+} vmake_arena;
+
+void vmake_arena_init(vmake_arena *arena);
+// Frees every allocation of the arena.
+void vmake_arena_free(vmake_arena *arena);
+// Returns `size` bytes that stay valid until they're released or the arena is freed. Never returns
+// NULL, and returns a valid pointer even if `size` is 0.
+void *vmake_arena_alloc(vmake_arena *arena, size_t size);
+// Resizes an allocation of `old_size` bytes, which may be NULL if `old_size` is 0.
+void *vmake_arena_realloc(vmake_arena *arena, void *ptr, size_t old_size, size_t new_size);
+// Gives back an allocation of `size` bytes, which must be the size it was allocated or resized
+// with. `ptr` may be NULL.
+void vmake_arena_release(vmake_arena *arena, void *ptr, size_t size);
+// Changes the number of bytes counted for memory the arena doesn't own but an object does, such as
+// the contents of arrays and tables, from `old_size` to `new_size`.
+void vmake_arena_account(vmake_arena *arena, size_t old_size, size_t new_size);
+// Copies `length` characters into the arena and NUL-terminates them.
+char *vmake_arena_strndup(vmake_arena *arena, const char *chars, size_t length);
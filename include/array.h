@@ -19,6 +19,8 @@ typedef struct vmake_variable_array {
 
 void vmake_value_array_new(vmake_value_array *arr);
 void vmake_value_array_free(vmake_value_array *arr);
+// Makes room for at least `capacity` values, so that pushing them doesn't reallocate.
+void vmake_value_array_reserve(vmake_value_array *arr, int capacity);
 void vmake_value_array_push(vmake_value_array *arr, vmake_value val);
 vmake_value vmake_value_array_pop(vmake_value_array *arr);
 bool vmake_value_array_contains(vmake_value_array *arr, vmake_value val);
@@ -0,0 +1,20 @@
+#pragma once
+
+typedef struct vmake_state vmake_state;
+
+// Names that natives and the Makefile emitter use to look up fields and bind arguments, as
+// VMAKE_ATOM(id, spelling) entries. Every atom is interned once when the state is created, so using
+// one is an array access instead of hashing the name and probing the string table.
+#define VMAKE_ATOMS(VMAKE_ATOM)                                                                    \
+  VMAKE_ATOM(ATOM_NAME, "name")                                                                    \
+  VMAKE_ATOM(ATOM_SOURCES, "sources")                                                              \
+  VMAKE_ATOM(ATOM_INCLUDE_DIRECTORIES, "include_directories")                                      \
+  VMAKE_ATOM(ATOM_LINK_LIBRARIES, "link_libraries")                                                \
+  VMAKE_ATOM(ATOM_INSTANCE, "instance")
+
+#define VMAKE_ATOM_ENUM(id, spelling) id,
+typedef enum vmake_atom { VMAKE_ATOMS(VMAKE_ATOM_ENUM) ATOM_T_MAX } vmake_atom;
+#undef VMAKE_ATOM_ENUM
+
+// Interns every atom into `state->atoms`.
+void vmake_atoms_init(vmake_state *state);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "chunk.h"
+#include "common.h"
+#include "file.h"
+#include "scanner.h"
+#include <stdbool.h>
+
+// Bump this whenever the layout of cache files or the meaning of the bytecode changes, so that
+// files compiled by an older vaq-make are never run.
+#define VMAKE_CACHE_FORMAT 8
+// The directory inside the build directory that compiled files are cached in.
+#define VMAKE_CACHE_DIRECTORY ".vmake-cache"
+
+// Loads the compiled form of `source` from the cache directory, where `hash` is
+// vmake_hash_bytes(source->chars, source->length). On success, `tokens` and `chunk` point into the
+// cache file, which stays loaded for as long as `state`, like sources do. Returns false if caching
+// is disabled, or if there is no entry for this version of the file.
+bool vmake_cache_load(vmake_state *state, vmake_source *source, uint64_t hash,
+                      vmake_token_buffer *tokens, vmake_chunk *chunk);
+// Returns whether the cache directory has an entry for the source with this hash, without loading
+// or validating it. This only reads the state, so it can be called from any thread.
+bool vmake_cache_contains(vmake_state *state, uint64_t hash);
+// Writes the compiled form of `source`, whose hash is `hash`, to the cache directory. Failing to
+// write the cache isn't an error, the file will just be compiled again on the next run.
+void vmake_cache_store(vmake_state *state, vmake_source *source, uint64_t hash,
+                       vmake_token_buffer *tokens, vmake_chunk *chunk);
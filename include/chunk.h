@@ -0,0 +1,104 @@
+#pragma once
+
+#include "array.h"
+#include "value.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Operands are written after the opcode. `name` and `constant` operands are 24-bit indices into
+// the constant pool, `global` operands are 24-bit indices into the chunk's globals, `cache`
+// operands are 24-bit indices into the chunk's inline caches, and `count` operands are single
+// bytes.
+typedef enum vmake_opcode {
+  // constant -> value
+  OP_CONSTANT,
+  OP_NIL,
+  OP_TRUE,
+  OP_FALSE,
+  OP_POP,
+  // global -> value. Globals that are never assigned to are nil.
+  OP_GET_GLOBAL,
+  // global, value -> value
+  OP_SET_GLOBAL,
+  // A single byte holding the slot of the local.
+  // -> value
+  OP_GET_LOCAL,
+  // value -> value
+  OP_SET_LOCAL,
+  // array, index -> element
+  OP_GET_INDEX,
+  // array, index, value -> value
+  OP_SET_INDEX,
+  // name, cache, instance -> field
+  OP_GET_PROPERTY,
+  // name, cache, instance -> callee, receiver. For fields, the receiver is an empty value.
+  OP_GET_METHOD,
+  // Two count operands for the positional and keyword arguments.
+  // callee, args..., (name, value)... -> result
+  OP_CALL,
+  // callee, receiver, args..., (name, value)... -> result
+  OP_INVOKE,
+  // Two bytes holding the expected number of elements, used to size the array.
+  // -> array
+  OP_ARRAY,
+  // array, value -> array
+  OP_APPEND,
+  OP_EQUAL,
+  OP_LESS,
+  OP_LESS_EQUAL,
+  OP_GREATER,
+  OP_GREATER_EQUAL,
+  OP_ADD,
+  OP_SUBTRACT,
+  OP_MULTIPLY,
+  OP_DIVIDE,
+  OP_NOT,
+  OP_NEGATE,
+  // value ->
+  OP_PRINT,
+  // path ->
+  OP_INCLUDE,
+  // path ->, but does nothing if the file was already processed.
+  OP_INCLUDE_ONCE,
+  OP_RETURN,
+} vmake_opcode;
+
+// Remembers where the property read by an instruction was found the last time it ran, for instances
+// of one shape.
+typedef struct vmake_inline_cache {
+  // The shape of the instance, or NULL if the instruction hasn't run yet.
+  struct vmake_obj_shape *shape;
+  // The slot of the field, or -1 if the property is a method.
+  int slot;
+  vmake_value method;
+} vmake_inline_cache;
+
+// A compiled VMake file.
+typedef struct vmake_chunk {
+  uint8_t *code;
+  // For every byte of code, the index of the token reported when the instruction fails.
+  // Instructions that can fail in more than one way also use the tokens of their operand bytes.
+  int *tokens;
+  int count;
+  int capacity;
+  vmake_value_array constants;
+  // The names of the globals used by the chunk. Global slots depend on the order in which files
+  // define their globals, so they're looked up when the chunk is run rather than compiled in.
+  vmake_value_array globals;
+  // The inline caches of the property accesses in the chunk. They're only filled in when the chunk
+  // runs, so compiled chunks just know how many there are.
+  vmake_inline_cache *caches;
+  int cache_count;
+  // Whether code and tokens point into a cache file instead of memory owned by the chunk.
+  bool borrowed;
+} vmake_chunk;
+
+void vmake_chunk_init(vmake_chunk *chunk);
+void vmake_chunk_free(vmake_chunk *chunk);
+void vmake_chunk_write(vmake_chunk *chunk, uint8_t byte, int token);
+// Adds a value to the constant pool and returns its index.
+int vmake_chunk_add_constant(vmake_chunk *chunk, vmake_value value);
+// Adds the name of a global to the chunk and returns its index.
+int vmake_chunk_add_global(vmake_chunk *chunk, vmake_value name);
+// Adds an inline cache to the chunk and returns its index.
+int vmake_chunk_add_cache(vmake_chunk *chunk);
@@ -1,12 +1,21 @@
 #pragma once
 
+#include "arena.h"
+#include "atom.h"
+#include "chunk.h"
+#include "file.h"
+#include "gc.h"
 #include "generator.h"
+#include "interner.h"
+#include "module.h"
 #include "value.h"
 #include <stdio.h>
 
 #define VMAKE_STRING_BUF_INITIAL_SIZE 8
 #define VMAKE_STRING_BUF_GROW_FACTOR 2
 
+#define VMAKE_ARRAY_COUNT(array) ((int)(sizeof(array) / sizeof(*(array))))
+
 typedef enum vmake_class_type { CLASS_EXECUTABLE, CLASS_T_MAX } vmake_class_type;
 
 typedef struct vmake_makefile {
@@ -22,11 +31,26 @@ typedef struct vmake_make_contents {
 } vmake_make_contents;
 
 typedef struct vmake_state {
+  // Every object of the state, most recent first. Objects are allocated from `arena`.
   vmake_obj *objects;
+  vmake_arena arena;
+  vmake_gc gc;
+  // The innermost running VM, which links to the ones waiting for it.
+  struct vmake_vm *vm;
+  // Every source file that was loaded, which must outlive any string borrowed from them.
+  vmake_source *sources;
+  // The directory compiled files are cached in, or NULL if caching is disabled.
+  char *cache_directory;
   vmake_obj_class *classes[CLASS_T_MAX];
+  // Maps the name of every global to its slot in global_values.
   vmake_table globals;
-  vmake_table strings;
-  vmake_value_array include_stack;
+  // The values of all globals, indexed by slot. Slots never change once they're given out.
+  vmake_value_array global_values;
+  vmake_interner strings;
+  // The interned string of every atom.
+  vmake_obj_string *atoms[ATOM_T_MAX];
+  // Every file that was processed, compiled or not.
+  vmake_module_table modules;
   vmake_make_contents make;
   char **argv;
   char *root_file;
@@ -37,13 +61,21 @@ typedef struct vmake_state {
 
 typedef struct vmake_gen {
   const char *file_path;
+  // The module being compiled or run.
+  vmake_module *module;
   vmake_state *state;
-  vmake_scanner *scanner;
+  vmake_token_buffer *tokens;
+  // The chunk the file is compiled into.
+  vmake_chunk *chunk;
+  // Maps every constant to its index in the chunk, so that each constant is only stored once.
+  vmake_table constants;
+  // The locals in scope, from the outermost to the innermost.
   vmake_variable_array locals;
-  vmake_value *stack[256];
-  vmake_token previous;
-  vmake_token current;
-  int stack_size;
+  // Maps the name of every global the file uses to its index in the chunk's globals.
+  vmake_table globals;
+  // The index of the token being looked at. The previous token is always the one before it.
+  int current;
+  // The number of blocks we're in, 0 being the top level of the file.
   int scope_depth;
 } vmake_gen;
 
@@ -65,7 +97,14 @@ typedef enum vmake_error_context {
   CTX_INTERNAL,
 } vmake_error_context;
 
+// Frees everything owned by the state, including every object.
+void vmake_state_free(vmake_state *state);
 void vmake_process_path(vmake_state *state, char *path);
+// Runs a module, compiling it first if this is the first time it's processed.
+void vmake_process_module(vmake_state *state, vmake_module *module);
+// Returns the slot of the global called `name`, defining it as nil if it doesn't exist.
+int vmake_global_slot(vmake_state *state, vmake_value name);
+void vmake_define_global(vmake_state *state, vmake_value name, vmake_value value);
 
 void vmake_verror(vmake_gen *gen, vmake_error_context context, vmake_token *token, const char *fmt,
                   va_list ap);
@@ -1,7 +1,22 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
+// The contents of a VMake file. Sources stay loaded for as long as the vmake_state that loaded
+// them, because strings created from the source (literals and identifiers) borrow its bytes instead
+// of copying them.
+typedef struct vmake_source {
+  // The contents of the file, followed by a NUL byte which the scanner uses to detect the end of
+  // the file.
+  const char *chars;
+  size_t length;
+  // Whether chars is a private file mapping created with mmap, or a buffer allocated with malloc.
+  bool mapped;
+  struct vmake_source *next;
+} vmake_source;
+
 // Equivalent to realpath(path, NULL);
 char *vmake_path_abs(const char *path);
 // Resolves a file path relative to another file.
@@ -12,5 +27,12 @@ char *vmake_path_rel(const char *current, const char *relative);
 // be a file path, not a directory path.
 char *vmake_path_abs_to_rel(const char *abs);
 
+// Loads the file at `path`. Files are memory-mapped when vaq-make is built with VMAKE_USE_MMAP,
+// and read into a heap buffer otherwise, or when the mapping wouldn't be followed by a NUL byte.
+vmake_source *vmake_source_load(const char *path);
+// Like vmake_source_load, but returns NULL instead of exiting if the file can't be opened.
+vmake_source *vmake_source_open(const char *path);
+void vmake_source_free(vmake_source *source);
+
 void vmake_create_directory(const char *path);
 FILE *vmake_new_makefile(const char *path);
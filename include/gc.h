@@ -0,0 +1,49 @@
+#pragma once
+
+#include "value.h"
+#include <stddef.h>
+
+// The number of bytes the arena can hold before the first collection.
+#ifndef VMAKE_GC_INITIAL_THRESHOLD
+#define VMAKE_GC_INITIAL_THRESHOLD (1024 * 1024)
+#endif
+// After a collection, the next one happens once the live heap has grown by this factor.
+#ifndef VMAKE_GC_GROW_FACTOR
+#define VMAKE_GC_GROW_FACTOR 2
+#endif
+#define VMAKE_GC_GRAY_INITIAL_SIZE 64
+
+typedef struct vmake_state vmake_state;
+
+typedef struct vmake_gc_stats {
+  // The number of bytes of objects the state holds, as counted by the arena.
+  size_t allocated;
+  // The heap size at which the next collection happens.
+  size_t threshold;
+  int collections;
+  // Totals over every collection.
+  size_t freed_bytes;
+  size_t freed_objects;
+} vmake_gc_stats;
+
+// A mark-and-sweep collector for the objects of a state. Collections only happen at safe points,
+// where every live object is reachable from the roots: the globals, the constants and include
+// tables of every module, the stacks of the running VMs, the targets, the builtin classes and the
+// atoms. Interned strings are weak: strings only referenced by the string table are collected and
+// removed from it.
+typedef struct vmake_gc {
+  vmake_gc_stats stats;
+  // Marked objects whose references haven't been marked yet.
+  vmake_obj **gray;
+  int gray_count;
+  int gray_capacity;
+} vmake_gc;
+
+void vmake_gc_init(vmake_gc *gc);
+void vmake_gc_free(vmake_gc *gc);
+// Frees every object that isn't reachable from the roots of the state.
+void vmake_gc_collect(vmake_state *state);
+// Collects if the heap has grown past the threshold. Must only be called at safe points.
+void vmake_gc_safepoint(vmake_state *state);
+void vmake_gc_mark_value(vmake_gc *gc, vmake_value val);
+void vmake_gc_mark_obj(vmake_gc *gc, vmake_obj *obj);
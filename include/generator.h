@@ -1,6 +1,8 @@
 #pragma once
 
 #include "array.h"
+#include "chunk.h"
+#include "module.h"
 #include "native/class.h"
 #include "object.h"
 #include "scanner.h"
@@ -9,10 +11,15 @@
 
 typedef struct vmake_obj_class vmake_obj_class;
 
+// A local variable. Locals live in stack slots, and the index of a local in the compiler's array of
+// locals is the index of its slot.
 typedef struct vmake_variable {
-  vmake_value value;
   vmake_token name;
+  // The depth of the scope the local was declared in.
   int depth;
 } vmake_variable;
 
-bool vmake_generate_build(vmake_scanner *scanner, vmake_state *state, const char *file_path);
+// Compiles the scanned tokens of a module into its chunk, which should be initialized.
+bool vmake_compile(vmake_module *module, vmake_state *state);
+// Runs a compiled module.
+bool vmake_generate_build(vmake_module *module, vmake_state *state);
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The hashes below are wyhash (https://github.com/wangyi-fudan/wyhash), which reads its input 8
+// bytes at a time and mixes it with 64x64->128 bit multiplications. Long inputs are consumed in
+// three independent lanes, so that the multiplications of one lane overlap with the others.
+
+#define VMAKE_HASH_SECRET0 0xa0761d6478bd642fULL
+#define VMAKE_HASH_SECRET1 0xe7037ed1a0b428dbULL
+#define VMAKE_HASH_SECRET2 0x8ebc6af09c88c6e3ULL
+#define VMAKE_HASH_SECRET3 0x589965cc75374cc3ULL
+
+// Multiplies `a` and `b` into 128 bits, and folds the halves together.
+static inline uint64_t vmake_hash_mix(uint64_t a, uint64_t b) {
+  __uint128_t product = (__uint128_t)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t vmake_hash_read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t vmake_hash_read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t vmake_wyhash(const void *key, size_t length, uint64_t seed) {
+  const uint8_t *p = key;
+  seed ^= vmake_hash_mix(seed ^ VMAKE_HASH_SECRET0, VMAKE_HASH_SECRET1);
+  uint64_t a, b;
+  if (length <= 16) {
+    if (length >= 4) {
+      // Two overlapping reads of 4 bytes from each end cover any length from 4 to 16.
+      size_t middle = (length >> 3) << 2;
+      a = vmake_hash_read32(p) << 32 | vmake_hash_read32(p + middle);
+      b = vmake_hash_read32(p + length - 4) << 32 | vmake_hash_read32(p + length - 4 - middle);
+    } else if (length > 0) {
+      a = (uint64_t)p[0] << 16 | (uint64_t)p[length >> 1] << 8 | p[length - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = length;
+    if (i > 48) {
+      uint64_t lane1 = seed, lane2 = seed;
+      do {
+        seed = vmake_hash_mix(vmake_hash_read64(p) ^ VMAKE_HASH_SECRET1,
+                              vmake_hash_read64(p + 8) ^ seed);
+        lane1 = vmake_hash_mix(vmake_hash_read64(p + 16) ^ VMAKE_HASH_SECRET2,
+                               vmake_hash_read64(p + 24) ^ lane1);
+        lane2 = vmake_hash_mix(vmake_hash_read64(p + 32) ^ VMAKE_HASH_SECRET3,
+                               vmake_hash_read64(p + 40) ^ lane2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= lane1 ^ lane2;
+    }
+    while (i > 16) {
+      seed = vmake_hash_mix(vmake_hash_read64(p) ^ VMAKE_HASH_SECRET1,
+                            vmake_hash_read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    // The last 16 bytes, which may overlap with bytes that were already mixed in.
+    a = vmake_hash_read64(p + i - 16);
+    b = vmake_hash_read64(p + i - 8);
+  }
+
+  __uint128_t product = (__uint128_t)(a ^ VMAKE_HASH_SECRET1) * (b ^ seed);
+  a = (uint64_t)product;
+  b = (uint64_t)(product >> 64);
+  return vmake_hash_mix(a ^ VMAKE_HASH_SECRET0 ^ length, b ^ VMAKE_HASH_SECRET1);
+}
+
+// The hash used to intern strings. The scanner hashes identifiers and string literals with it as
+// it lexes them, so that interning them later doesn't hash them again. Compiled files store these
+// hashes, so VMAKE_CACHE_FORMAT must be bumped whenever this changes.
+static inline uint32_t vmake_hash_chars(const char *chars, int length) {
+  uint64_t hash = vmake_wyhash(chars, length, 0);
+  return (uint32_t)(hash ^ hash >> 32);
+}
+
+// The hash used to key compiled files in the cache. It's 64 bits wide, since collisions between
+// different versions of a file would make us run stale code.
+static inline uint64_t vmake_hash_bytes(const char *bytes, size_t length) {
+  return vmake_wyhash(bytes, length, 0);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The size of the pages the characters of detached literals are packed into.
+#define VMAKE_INTERNER_PAGE_SIZE (64 * 1024)
+// The interner grows once more than 3/4 of its slots are used or deleted.
+#define VMAKE_INTERNER_MAX_LOAD_NUM 3
+#define VMAKE_INTERNER_MAX_LOAD_DEN 4
+
+typedef struct vmake_obj_string vmake_obj_string;
+
+// A slot of the hash table, which holds the hash of a string along with its index, so that probing
+// only touches a string whose hash matches.
+typedef struct vmake_interner_slot {
+  uint32_t hash;
+  // The index of the string in `strings`, or one of the negative values in interner.c.
+  int32_t index;
+} vmake_interner_slot;
+
+// The set of interned strings, which guarantees that two strings with the same characters are the
+// same object. It's an open addressing hash table from string hashes to indices into a dense array
+// of strings, with linear probing.
+//
+// The interner also owns the characters of literals that were borrowed from a source and later
+// needed their own NUL-terminated copy. Like sources, they live as long as the state, so they're
+// packed one after the other into pages that only ever grow, instead of being allocated one by one
+// from the arena. Strings created while running always live in the arena, where the garbage
+// collector can free them.
+typedef struct vmake_interner {
+  // The number of interned strings.
+  int count;
+  // The number of slots, which is 0 or a power of 2.
+  int capacity;
+  // The number of slots whose string was removed.
+  int deleted;
+  vmake_interner_slot *slots;
+  // Interned strings, NULL for the ones that were removed, which are compacted away when the table
+  // is rehashed.
+  vmake_obj_string **strings;
+  int string_count;
+  int string_capacity;
+  // The pages holding characters. Only the last one has room left.
+  char **pages;
+  int page_count;
+  // The unused part of the last page.
+  char *next;
+  char *end;
+  // The number of bytes of all pages.
+  size_t page_bytes;
+} vmake_interner;
+
+void vmake_interner_init(vmake_interner *interner);
+void vmake_interner_free(vmake_interner *interner);
+// Returns the interned string with the given characters, or NULL if there's none. `hash` must be
+// vmake_hash_chars(chars, length), which the scanner computes for every token.
+vmake_obj_string *vmake_interner_find(vmake_interner *interner, const char *chars, int length,
+                                      uint32_t hash);
+// Interns `str`, whose characters must not be interned yet.
+void vmake_interner_add(vmake_interner *interner, vmake_obj_string *str);
+// Removes `str`, which must be interned.
+void vmake_interner_remove(vmake_interner *interner, vmake_obj_string *str);
+// Copies `length` characters into the interner's pages and NUL-terminates them. The copy stays
+// valid until the interner is freed.
+char *vmake_interner_copy_chars(vmake_interner *interner, const char *chars, int length);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "chunk.h"
+#include "file.h"
+#include "scanner.h"
+#include "table.h"
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define VMAKE_MODULES_INITIAL_SIZE 16
+#define VMAKE_MODULES_GROW_FACTOR 2
+
+typedef struct vmake_state vmake_state;
+
+// A VMake file. Modules are compiled the first time they're processed and then kept for as long as
+// the state, so including a file again only runs its chunk again.
+typedef struct vmake_module {
+  // The canonical absolute path of the file.
+  char *path;
+  // Identifies the file no matter which path it was reached through.
+  dev_t dev;
+  ino_t ino;
+  // The index of the module in the module table.
+  int index;
+  // The contents of the file, or NULL if it hasn't been loaded yet.
+  vmake_source *source;
+  // The hash of the contents, which keys the file in the cache. It's computed along with `source`,
+  // on the worker thread when the module is prepared.
+  uint64_t hash;
+  // Whether `tokens` holds the tokens of the source, scanned or loaded from the cache.
+  bool scanned;
+  // Whether `chunk` holds the compiled module, compiled or loaded from the cache.
+  bool compiled;
+  // Whether the module was found by vmake_module_prepare, so that it's only prepared once.
+  bool prepared;
+  vmake_token_buffer tokens;
+  vmake_chunk chunk;
+  // Maps the include paths used by this module, as written, to the index of the module they
+  // resolved to, so that each include path is only resolved once.
+  vmake_table includes;
+  // The module that included this one, while it's running.
+  struct vmake_module *included_from;
+  // Whether the module is running, which is how cyclic includes are detected.
+  bool active;
+  // The number of times the module was run.
+  int run_count;
+} vmake_module;
+
+// Every module of a state, indexed both by position and by device and inode numbers.
+typedef struct vmake_module_table {
+  vmake_module **modules;
+  int count;
+  int capacity;
+  // Open addressing buckets holding indices into modules, or -1 when empty. There are twice as many
+  // buckets as modules can fit in `modules`.
+  int *buckets;
+} vmake_module_table;
+
+void vmake_module_table_init(vmake_module_table *table);
+void vmake_module_table_free(vmake_module_table *table);
+// Returns the module for the file at `path`, which must be a canonical absolute path, adding it to
+// the table if it isn't there yet. Returns NULL if the file doesn't exist.
+vmake_module *vmake_module_get(vmake_module_table *table, const char *path);
+
+// Loads the source of a module, and either its compiled form from the cache or its tokens.
+void vmake_module_load(vmake_state *state, vmake_module *module);
+// Walks the include graph starting at `root` through the includes whose path is a string literal,
+// loading and scanning the files it finds ahead of time. Files are scanned concurrently when
+// vaq-make is built with VMAKE_PARALLEL_INCLUDES. Running the modules is left to
+// vmake_process_module, which finds them ready to be compiled.
+void vmake_module_prepare(vmake_state *state, vmake_module *root);
@@ -3,11 +3,13 @@
 #include "object.h"
 
 void vmake_define_native_functions(vmake_state *state);
+// `params` must outlive the state, and is usually a static table next to the native.
 void vmake_define_native_function(vmake_state *state, const char *name, vmake_native_function fn,
-                                  int argc);
-vmake_value vmake_kwargs_get(vmake_gen *gen, vmake_table kwargs, const char *value);
+                                  const vmake_param *params, int param_count);
 
 // TODO: Start adding and implementing these functions. These are the core of the VMake language,
 // because VMake in itself is not designed to be Turing complete.
 vmake_value vmake_executable_native(vmake_gen *gen, vmake_arguments *args);
 vmake_value vmake_get_properties_native(vmake_gen *gen, vmake_arguments *args);
+// Returns a table describing the heap and the work done by the garbage collector so far.
+vmake_value vmake_heap_stats_native(vmake_gen *gen, vmake_arguments *args);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "array.h"
+#include "atom.h"
 #include "generator.h"
 #include "table.h"
 #include "value.h"
@@ -20,23 +21,80 @@ typedef enum vmake_obj_type {
   OBJ_INSTANCE,
   OBJ_METHOD,
   OBJ_TABLE,
+  OBJ_ROPE,
+  OBJ_SHAPE,
 } vmake_obj_type;
 
 typedef struct vmake_obj {
   vmake_obj_type type;
+  // Set while the garbage collector finds the reachable objects.
+  bool marked;
   vmake_obj *next;
 } vmake_obj;
 
+// Borrowed strings up to this length get their own copy of their characters anyway.
+#define VMAKE_STRING_SHORT_MAX 32
+
 typedef struct vmake_obj_string {
   vmake_obj obj;
-  char *chars;
   int length;
   uint32_t hash;
+  // NUL-terminated, unless the string is borrowed. Points to `bytes`, except for strings created
+  // with vmake_obj_string_borrow that were too long to be copied, which point into their source
+  // until they're detached into the interner's pages.
+  char *chars;
+  // Whether chars points into a loaded source file.
+  bool borrowed;
+  // The characters of the string, allocated along with it.
+  char bytes[];
 } vmake_obj_string;
 
+// The result of concatenating two strings, which is only flattened into a string when its
+// characters are needed. This makes chains of concatenations linear instead of quadratic, and keeps
+// the intermediate results out of the string table. Ropes never escape the VM: they're flattened
+// before being stored in an array, passed to a native, compared, or printed.
+typedef struct vmake_obj_rope {
+  vmake_obj obj;
+  // Strings or ropes.
+  vmake_obj *left;
+  vmake_obj *right;
+  int length;
+  // The flattened rope, or NULL if it hasn't been flattened yet.
+  vmake_obj_string *flat;
+} vmake_obj_rope;
+
+#define VMAKE_MAX_PARAMS 8
+
+typedef enum vmake_param_type {
+  PARAM_ANY,
+  PARAM_STRING,
+  PARAM_ARRAY,
+  PARAM_INSTANCE,
+} vmake_param_type;
+
+// A parameter of a native function or method. Parameters can be passed by position or by name,
+// except for keyword-only ones, which must come after all the others.
+typedef struct vmake_param {
+  vmake_atom name;
+  vmake_param_type type;
+  // Optional parameters are bound to nil when they aren't passed. They don't accept nil otherwise.
+  bool optional;
+  bool keyword_only;
+} vmake_param;
+
+typedef struct vmake_signature {
+  const vmake_param *params;
+  // Interned parameter names, so that keyword arguments can be matched by identity.
+  vmake_obj_string *names[VMAKE_MAX_PARAMS];
+  int count;
+  // The number of parameters that can be passed by position.
+  int positional;
+} vmake_signature;
+
+// The arguments of a call, bound by the VM to the parameters of the callee's signature. Slot `i`
+// holds the argument for parameter `i`, which has already been type checked.
 typedef struct vmake_arguments {
-  vmake_value_array args;
-  vmake_table kwargs;
+  vmake_value slots[VMAKE_MAX_PARAMS];
 } vmake_arguments;
 
 typedef struct vmake_value (*vmake_native_function)(vmake_gen *gen, vmake_arguments *args);
@@ -47,71 +105,172 @@ typedef struct vmake_obj_native {
   vmake_obj obj;
   vmake_obj_string *name;
   vmake_native_function function;
-  int arity;
+  vmake_signature signature;
 } vmake_obj_native;
 
+// The elements of an array, shared by the copies of the array until one of them is modified.
+typedef struct vmake_array_storage {
+  // The number of arrays using the storage.
+  int refs;
+  vmake_value_array array;
+  // The bytes of the elements counted in the arena of the state.
+  size_t bytes;
+} vmake_array_storage;
+
 typedef struct vmake_obj_array {
   vmake_obj obj;
-  vmake_value_array *array;
+  vmake_array_storage *storage;
 } vmake_obj_array;
 
+// The layout of an instance, that is which field is stored in which slot. Shapes form a tree rooted
+// at the empty shape of each class, and instances that get the same fields in the same order share
+// a shape, so checking the shape of an instance is enough to know where a field is.
+typedef struct vmake_obj_shape {
+  vmake_obj obj;
+  // The name of the field in each slot.
+  vmake_obj_string **names;
+  int field_count;
+  // The shapes that add one more field to this one, linked through next_sibling.
+  struct vmake_obj_shape *children;
+  struct vmake_obj_shape *next_sibling;
+} vmake_obj_shape;
+
 typedef struct vmake_obj_class {
   vmake_obj obj;
   vmake_obj_string *name;
   vmake_table methods;
+  // The shape of instances without fields.
+  vmake_obj_shape *shape;
 } vmake_obj_class;
 
 typedef struct vmake_obj_instance {
   vmake_obj obj;
   vmake_obj_class *klass;
-  vmake_table fields;
+  vmake_obj_shape *shape;
+  // The value of every field, indexed by the slots of the shape.
+  vmake_value *fields;
+  // The table mapping field names to their values, built the first time it's needed and dropped
+  // whenever a field is added.
+  struct vmake_obj_table *properties;
 } vmake_obj_instance;
 
 typedef struct vmake_obj_method {
   vmake_obj obj;
   vmake_obj_string *name;
   vmake_native_method method;
-  int arity;
+  vmake_signature signature;
 } vmake_obj_method;
 
+// The entries of a table, shared by the copies of the table until one of them is modified.
+typedef struct vmake_table_storage {
+  // The number of tables using the storage.
+  int refs;
+  vmake_table table;
+  // The bytes of the entries counted in the arena of the state.
+  size_t bytes;
+} vmake_table_storage;
+
 typedef struct vmake_obj_table {
   vmake_obj obj;
-  vmake_table *table;
+  vmake_table_storage *storage;
 } vmake_obj_table;
 
 char *vmake_obj_type_to_string(vmake_obj_type type);
+char *vmake_param_type_to_string(vmake_param_type type);
+
+// `params` must outlive the signature, and have at most VMAKE_MAX_PARAMS elements.
+void vmake_signature_init(vmake_signature *sig, vmake_state *state, const vmake_param *params,
+                          int count);
 
 vmake_obj *vmake_obj_new(vmake_state *state, size_t size, vmake_obj_type type);
 char *vmake_obj_to_string(vmake_obj *obj);
 void vmake_obj_print(vmake_obj *obj);
-void vmake_obj_free(vmake_obj *obj);
+// Frees an object and everything it owns, but not the objects it references.
+void vmake_obj_free(vmake_state *state, vmake_obj *obj);
+// Frees every object of the state at once.
+void vmake_objects_free(vmake_state *state);
 
 vmake_obj_string *vmake_obj_string_const(vmake_state *state, const char *str);
 vmake_obj_string *vmake_obj_string_new(vmake_state *state, char *chars, int length, bool copy);
-void vmake_obj_string_free(vmake_obj_string *obj);
+// Interns a string without copying its characters, which must outlive the state (in practice, they
+// point into a vmake_source). The characters of the resulting string are not NUL-terminated, until
+// the same string is requested through vmake_obj_string_new, at which point it gets its own copy.
+// Strings of up to VMAKE_STRING_SHORT_MAX characters are copied right away.
+// `hash` must be vmake_hash_chars(chars, length), which the scanner computes for every identifier
+// and string token.
+vmake_obj_string *vmake_obj_string_borrow(vmake_state *state, const char *chars, int length,
+                                          uint32_t hash);
+void vmake_obj_string_free(vmake_state *state, vmake_obj_string *obj);
+
+// `left` and `right` must be strings or ropes.
+vmake_obj_rope *vmake_obj_rope_new(vmake_state *state, vmake_obj *left, vmake_obj *right);
+// Writes the characters of the rope to `dst`, which must have room for `rope->length` characters.
+void vmake_obj_rope_write(vmake_obj_rope *rope, char *dst);
+// Returns the interned string with the characters of the rope.
+vmake_obj_string *vmake_obj_rope_flatten(vmake_state *state, vmake_obj_rope *rope);
 
 vmake_obj_native *vmake_obj_native_new(vmake_state *state, const char *name,
-                                       vmake_native_function function, int arity);
-void vmake_obj_native_free(vmake_obj_native *obj);
+                                       vmake_native_function function, const vmake_param *params,
+                                       int param_count);
+void vmake_obj_native_free(vmake_state *state, vmake_obj_native *obj);
+
+// Arrays and tables own their contents, and are copied in constant time by sharing them. The
+// contents are only copied when a shared array or table is modified, so anything that may modify
+// one must get its contents through vmake_obj_array_mut or vmake_obj_table_mut.
 
+// Takes ownership of `array`.
 vmake_obj_array *vmake_obj_array_new(vmake_state *state, vmake_value_array array);
-void vmake_obj_array_free(vmake_obj_array *obj);
+vmake_obj_array *vmake_obj_array_copy(vmake_state *state, vmake_obj_array *obj);
+// Returns the elements of the array, after making sure no other array shares them.
+vmake_value_array *vmake_obj_array_mut(vmake_state *state, vmake_obj_array *obj);
+// Appends `val` to the array, and counts the memory the elements grow by in the arena.
+void vmake_obj_array_push(vmake_state *state, vmake_obj_array *obj, vmake_value val);
+void vmake_obj_array_free(vmake_state *state, vmake_obj_array *obj);
+
+vmake_obj_shape *vmake_obj_shape_new(vmake_state *state);
+// Returns the slot of the field called `name`, or -1 if the shape has no such field.
+int vmake_obj_shape_find(vmake_obj_shape *shape, vmake_obj_string *name);
+// Returns the shape with the fields of `shape` followed by `name`.
+vmake_obj_shape *vmake_obj_shape_add(vmake_state *state, vmake_obj_shape *shape,
+                                     vmake_obj_string *name);
+void vmake_obj_shape_free(vmake_state *state, vmake_obj_shape *obj);
 
 vmake_obj_class *vmake_obj_class_new(vmake_state *state, const char *name);
 void vmake_obj_class_add_method(vmake_obj_class *obj, vmake_state *state, const char *name,
-                                vmake_native_method method, int arity);
-void vmake_obj_class_free(vmake_obj_class *obj);
+                                vmake_native_method method, const vmake_param *params,
+                                int param_count);
+void vmake_obj_class_free(vmake_state *state, vmake_obj_class *obj);
 
 vmake_obj_instance *vmake_obj_instance_new(vmake_state *state, vmake_obj_class *klass);
-void vmake_obj_instance_add_field(vmake_obj_instance *obj, vmake_state *state, const char *name,
+void vmake_obj_instance_add_field(vmake_obj_instance *obj, vmake_state *state, vmake_atom name,
                                   vmake_value value);
+// Returns the field called `name`, or NULL if there's no such field.
+vmake_value *vmake_obj_instance_find_field(vmake_obj_instance *obj, vmake_obj_string *name);
+// Returns a table mapping the name of every field to its value, which must not be modified.
+vmake_obj_table *vmake_obj_instance_properties(vmake_obj_instance *obj, vmake_state *state);
+// Returns the field called `name`, or nil if there's no such field.
 vmake_value vmake_obj_instance_get_field(vmake_obj_instance *obj, vmake_state *state,
-                                         const char *name);
-void vmake_obj_instance_free(vmake_obj_instance *obj);
+                                         vmake_atom name);
+void vmake_obj_instance_free(vmake_state *state, vmake_obj_instance *obj);
 
 vmake_obj_method *vmake_obj_method_new(vmake_state *state, const char *name,
-                                       vmake_native_method method, int arity);
-void vmake_obj_method_free(vmake_obj_method *obj);
+                                       vmake_native_method method, const vmake_param *params,
+                                       int param_count);
+void vmake_obj_method_free(vmake_state *state, vmake_obj_method *obj);
 
+// Takes ownership of `table`.
 vmake_obj_table *vmake_obj_table_new(vmake_state *state, vmake_table table);
-void vmake_obj_table_free(vmake_obj_table *obj);
+vmake_obj_table *vmake_obj_table_copy(vmake_state *state, vmake_obj_table *obj);
+// Returns the entries of the table, after making sure no other table shares them.
+vmake_table *vmake_obj_table_mut(vmake_state *state, vmake_obj_table *obj);
+void vmake_obj_table_free(vmake_state *state, vmake_obj_table *obj);
+
+// Returns the elements of the array, which must not be modified.
+static inline const vmake_value_array *vmake_obj_array_values(const vmake_obj_array *obj) {
+  return &obj->storage->array;
+}
+
+// Returns the entries of the table, which must not be modified.
+static inline vmake_table *vmake_obj_table_entries(const vmake_obj_table *obj) {
+  return &obj->storage->table;
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 typedef enum vmake_token_type {
   TOKEN_NONE,
   TOKEN_EOF,
@@ -29,16 +33,32 @@ typedef enum vmake_token_type {
   TOKEN_TRUE,
   TOKEN_NIL,
   TOKEN_INCLUDE,
+  TOKEN_INCLUDE_ONCE,
+  TOKEN_LOCAL,
   TOKEN_LEFT_SQUARE_BRACKET,
   TOKEN_RIGHT_SQUARE_BRACKET,
+  TOKEN_LEFT_BRACE,
+  TOKEN_RIGHT_BRACE,
+  TOKEN_T_MAX,
 } vmake_token_type;
 
+// A value computed by the scanner while lexing a token, so that the generator doesn't need to look
+// at the characters of the token again.
+typedef union vmake_token_value {
+  // For TOKEN_NUMBER, the parsed number.
+  double number;
+  // For TOKEN_IDENTIFIER and TOKEN_STRING, the hash the name is interned with. The length of the
+  // string is the length of the token, since VMake strings have no escape sequences.
+  uint32_t hash;
+} vmake_token_value;
+
 typedef struct vmake_token {
   // This pointer is not null-terminated
   const char *name;
   int name_length;
   int line;
   vmake_token_type type;
+  vmake_token_value value;
 } vmake_token;
 
 typedef struct vmake_scanner {
@@ -46,9 +66,39 @@ typedef struct vmake_scanner {
   const char *token_start;
   // A pointer to the current character we're reading
   const char *current_char;
+  // A pointer to the NUL byte that terminates the source
+  const char *source_end;
   // The line we're currently on
   int line;
 } vmake_scanner;
 
-vmake_scanner vmake_init_scanner(const char *source);
+// A whole file scanned ahead of time, stored as a struct of arrays. The parser walks the tokens by
+// index, so lookahead is free, and since it mostly looks at token types, those are kept in their
+// own byte array.
+typedef struct vmake_token_buffer {
+  // The source the tokens were scanned from. Offsets are relative to this pointer.
+  const char *source;
+  uint8_t *types;
+  uint32_t *offsets;
+  uint32_t *lengths;
+  // Lines are only needed to report errors, so they're kept apart from the rest.
+  uint32_t *lines;
+  vmake_token_value *values;
+  int count;
+  int capacity;
+  // Whether the arrays point into a cache file instead of memory owned by the buffer.
+  bool borrowed;
+} vmake_token_buffer;
+
+// Picks the fastest scanning kernels for the CPU. Scanning does this on its own the first time, but
+// it must have been done before scanning on several threads at once.
+void vmake_scanner_setup(void);
+vmake_scanner vmake_init_scanner(const char *source, size_t length);
 vmake_token vmake_scan_token(vmake_scanner *scanner);
+
+// Scans a whole source into `buf`, up to and including the EOF token. Since this doesn't depend on
+// anything but the source, it can run on a different thread than the parser.
+void vmake_token_buffer_scan(vmake_token_buffer *buf, const char *source, size_t length);
+void vmake_token_buffer_free(vmake_token_buffer *buf);
+// Returns the token at `index`, or a token with type TOKEN_NONE if `index` is negative.
+vmake_token vmake_token_buffer_get(vmake_token_buffer *buf, int index);
@@ -3,19 +3,45 @@
 #include "value.h"
 #include <stdint.h>
 
-#define VMAKE_TABLE_LOAD_FACTOR 0.5
-
-typedef struct vmake_obj_string vmake_obj_string;
+// The number of control bytes probed at once, which is the width of an SSE2 register.
+#define VMAKE_TABLE_GROUP_SIZE 16
+// Tables grow once more than 7/8 of their slots are full or deleted.
+#define VMAKE_TABLE_MAX_LOAD_NUM 7
+#define VMAKE_TABLE_MAX_LOAD_DEN 8
+// Entries are stored in pages of this many entries, which never move once allocated.
+#define VMAKE_TABLE_PAGE_BITS 6
+#define VMAKE_TABLE_PAGE_SIZE (1 << VMAKE_TABLE_PAGE_BITS)
 
+// A key and its value. The key is empty once the entry is removed.
 typedef struct vmake_table_entry {
   vmake_value key;
-  vmake_value *value;
+  vmake_value value;
 } vmake_table_entry;
 
+// An open addressing hash table in the style of Swiss tables. Each slot has a control byte which
+// is either empty, deleted, or holds 7 bits of the hash of the key in the slot, so that probing
+// compares a whole group of control bytes with one SIMD instruction and only compares the keys
+// whose hash bits match.
+//
+// Slots don't hold the entries themselves but their index. Entries are stored in insertion order,
+// in pages that never move, so pointers to values stay valid until their entry is removed, even if
+// the table grows.
 typedef struct vmake_table {
+  // The number of entries in the table.
   int count;
+  // The number of slots, which is 0 or a power of 2 no smaller than VMAKE_TABLE_GROUP_SIZE.
   int capacity;
-  vmake_table_entry *entries;
+  // The number of slots whose entry was removed.
+  int deleted;
+  int8_t *control;
+  uint32_t *slots;
+  // The number of entries handed out, removed or not, and the number of pages they fit in.
+  int entry_count;
+  int page_count;
+  vmake_table_entry **pages;
+  // Removed entries, which are reused before handing out new ones. Each links to the next one
+  // through its value.
+  int free_entry;
 } vmake_table;
 
 // Initializes a vmake_table pointer
@@ -25,12 +51,14 @@ void vmake_table_free(vmake_table *table);
 // Copies the contents of `from` into `to`
 void vmake_table_copy_to(vmake_table *from, vmake_table *to);
 // Puts an entry with the given key and value into the table, expanding the
-// table if necessary. `key` should not be NULL. Returns true if the key didn't
+// table if necessary. `key` should not be empty. Returns true if the key didn't
 // exist previously in the table, or false if it did, that is, the return value
-// indicates if this key is a new key.
+// indicates if this key is a new key. If `inserted` isn't NULL, it's set to the
+// value in the table.
 bool vmake_table_put_cpy_ret(vmake_table *table, vmake_value key, vmake_value value,
                              vmake_value **inserted);
 bool vmake_table_put_cpy(vmake_table *table, vmake_value key, vmake_value value);
+// Same as vmake_table_put_cpy, but copies the value `value` points to, or nil if `value` is NULL.
 bool vmake_table_put_ptr(vmake_table *table, vmake_value key, vmake_value *value);
 bool vmake_table_put_ret(vmake_table *table, vmake_value key, vmake_value *value,
                          vmake_value **inserted);
@@ -40,7 +68,7 @@ bool vmake_table_remove(vmake_table *table, vmake_value key);
 // Retrieves the value associated with a key. The value is stored in the `value`
 // pointer passed to the function. Returns true if the key exists in the table,
 // or false if it doesn't, in which case `value` is unmodified. If `value` is
-// NULL, it is also unmodified.
+// NULL, it is also unmodified. The pointer stays valid until the key is removed.
 bool vmake_table_get(vmake_table *table, vmake_value key, vmake_value **value);
 // Same as vmake_table_get, but makes value point to a vmake_value with type VAL_NIL if the key is
 // not present.
@@ -48,15 +76,14 @@ bool vmake_table_get_or_nil(vmake_table *table, vmake_value key, vmake_value **v
 // Returns true if the key exists in the table, or false if it doesn't. This is
 // equivalent to vmake_table_get(table, key, NULL)
 bool vmake_table_has(vmake_table *table, vmake_value key);
-// Finds the entry where a key should go, given a list of entries and a
-// capacity. `key` should not be NULL
-vmake_table_entry *vmake_table_find_entry(vmake_table_entry *entries, int capacity,
-                                          vmake_value key);
-// Finds the key containing the given string. The hash is required for faster
-// comparison, since two strings different hashes are certainly not equal. This
-// only exists to 'bootstrap' lox_hash_table_find_entry by deduplicating
-// strings.
-vmake_obj_string *vmake_table_find_string(vmake_table *table, const char *chars, int length,
-                                          uint32_t hash);
-// Resizes a hash table to the given size.
+// Returns the number of bytes the table has allocated.
+size_t vmake_table_bytes(const vmake_table *table);
+// Resizes a hash table to the given number of slots, which must be a power of 2 that fits every
+// entry.
 void vmake_table_resize(vmake_table *table, int new_capacity);
+
+// Returns the entry at `index` in insertion order, for indices below `table->entry_count`. Entries
+// whose key is empty were removed and must be skipped.
+static inline vmake_table_entry *vmake_table_entry_at(vmake_table *table, int index) {
+  return &table->pages[index >> VMAKE_TABLE_PAGE_BITS][index & (VMAKE_TABLE_PAGE_SIZE - 1)];
+}
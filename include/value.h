@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 typedef struct vmake_obj vmake_obj;
 
@@ -13,7 +14,105 @@ typedef enum vmake_value_type {
   VAL_OBJ
 } vmake_value_type;
 
-typedef struct vmake_obj vmake_obj;
+// Values are only created, inspected and taken apart through the functions below, so that their
+// representation can be switched at compile time. By default a value is a tagged union, which takes
+// 16 bytes. With VMAKE_NAN_BOXING, a value is a single 64-bit word: numbers are stored as their
+// IEEE 754 bits, and every other value is hidden in the payload of a quiet NaN that arithmetic
+// never produces.
+#ifdef VMAKE_NAN_BOXING
+
+// The bits set in every value that isn't a number.
+#define VMAKE_QNAN ((uint64_t)0x7ffc000000000000)
+// Set, along with VMAKE_QNAN, in objects, whose pointer is stored in the low 48 bits.
+#define VMAKE_SIGN_BIT ((uint64_t)0x8000000000000000)
+#define VMAKE_TAG_EMPTY 1
+#define VMAKE_TAG_NIL 2
+// Booleans only differ in their lowest bit.
+#define VMAKE_TAG_FALSE 4
+#define VMAKE_TAG_TRUE 5
+
+typedef struct vmake_value {
+  uint64_t bits;
+} vmake_value;
+
+static inline vmake_value vmake_value_empty() {
+  return (vmake_value){VMAKE_QNAN | VMAKE_TAG_EMPTY};
+}
+
+static inline vmake_value vmake_value_number(double number) {
+  vmake_value val;
+  memcpy(&val.bits, &number, sizeof(double));
+  return val;
+}
+
+static inline vmake_value vmake_value_bool(bool boolean) {
+  return (vmake_value){VMAKE_QNAN | (boolean ? VMAKE_TAG_TRUE : VMAKE_TAG_FALSE)};
+}
+
+static inline vmake_value vmake_value_nil() { return (vmake_value){VMAKE_QNAN | VMAKE_TAG_NIL}; }
+
+static inline vmake_value vmake_value_obj(vmake_obj *obj) {
+  return (vmake_value){VMAKE_SIGN_BIT | VMAKE_QNAN | (uint64_t)(uintptr_t)obj};
+}
+
+static inline bool vmake_value_is_empty(vmake_value val) {
+  return val.bits == (VMAKE_QNAN | VMAKE_TAG_EMPTY);
+}
+
+static inline bool vmake_value_is_number(vmake_value val) {
+  return (val.bits & VMAKE_QNAN) != VMAKE_QNAN;
+}
+
+static inline bool vmake_value_is_bool(vmake_value val) {
+  return (val.bits | 1) == (VMAKE_QNAN | VMAKE_TAG_TRUE);
+}
+
+static inline bool vmake_value_is_nil(vmake_value val) {
+  return val.bits == (VMAKE_QNAN | VMAKE_TAG_NIL);
+}
+
+static inline bool vmake_value_is_obj(vmake_value val) {
+  return (val.bits & (VMAKE_QNAN | VMAKE_SIGN_BIT)) == (VMAKE_QNAN | VMAKE_SIGN_BIT);
+}
+
+static inline double vmake_value_as_number(vmake_value val) {
+  double number;
+  memcpy(&number, &val.bits, sizeof(double));
+  return number;
+}
+
+static inline bool vmake_value_as_bool(vmake_value val) {
+  return val.bits == (VMAKE_QNAN | VMAKE_TAG_TRUE);
+}
+
+static inline vmake_obj *vmake_value_as_obj(vmake_value val) {
+  return (vmake_obj *)(uintptr_t)(val.bits & ~(VMAKE_SIGN_BIT | VMAKE_QNAN));
+}
+
+static inline vmake_value_type vmake_value_get_type(vmake_value val) {
+  if (vmake_value_is_number(val))
+    return VAL_NUMBER;
+  if (vmake_value_is_obj(val))
+    return VAL_OBJ;
+  switch (val.bits & ~VMAKE_QNAN) {
+  case VMAKE_TAG_NIL:
+    return VAL_NIL;
+  case VMAKE_TAG_FALSE:
+  case VMAKE_TAG_TRUE:
+    return VAL_BOOL;
+  default:
+    return VAL_EMPTY;
+  }
+}
+
+static inline bool vmake_value_equals(vmake_value a, vmake_value b) {
+  // Numbers are compared as doubles, so that 0 equals -0 and NaN equals nothing.
+  if (vmake_value_is_number(a))
+    return vmake_value_is_number(b) && vmake_value_as_number(a) == vmake_value_as_number(b);
+  return a.bits == b.bits && !vmake_value_is_empty(a);
+}
+
+#else
 
 typedef struct vmake_value {
   vmake_value_type type;
@@ -24,23 +123,66 @@ typedef struct vmake_value {
   } as;
 } vmake_value;
 
-char *vmake_value_type_to_string(vmake_value_type type);
+static inline vmake_value vmake_value_empty() { return (vmake_value){VAL_EMPTY, {.number = 0}}; }
+
+static inline vmake_value vmake_value_number(double number) {
+  return (vmake_value){VAL_NUMBER, {.number = number}};
+}
+
+static inline vmake_value vmake_value_bool(bool boolean) {
+  return (vmake_value){VAL_BOOL, {.boolean = boolean}};
+}
+
+static inline vmake_value vmake_value_nil() { return (vmake_value){VAL_NIL, {.number = 0}}; }
+
+static inline vmake_value vmake_value_obj(vmake_obj *obj) {
+  return (vmake_value){VAL_OBJ, {.obj = obj}};
+}
 
-vmake_value vmake_value_empty();
-vmake_value vmake_value_number(double number);
-vmake_value vmake_value_bool(bool boolean);
-vmake_value vmake_value_nil();
-vmake_value vmake_value_obj(vmake_obj *obj);
+static inline bool vmake_value_is_empty(vmake_value val) { return val.type == VAL_EMPTY; }
+static inline bool vmake_value_is_number(vmake_value val) { return val.type == VAL_NUMBER; }
+static inline bool vmake_value_is_bool(vmake_value val) { return val.type == VAL_BOOL; }
+static inline bool vmake_value_is_nil(vmake_value val) { return val.type == VAL_NIL; }
+static inline bool vmake_value_is_obj(vmake_value val) { return val.type == VAL_OBJ; }
+
+static inline double vmake_value_as_number(vmake_value val) { return val.as.number; }
+static inline bool vmake_value_as_bool(vmake_value val) { return val.as.boolean; }
+static inline vmake_obj *vmake_value_as_obj(vmake_value val) { return val.as.obj; }
+
+static inline vmake_value_type vmake_value_get_type(vmake_value val) { return val.type; }
+
+static inline bool vmake_value_equals(vmake_value a, vmake_value b) {
+  if (a.type != b.type)
+    return false;
+
+  switch (a.type) {
+  case VAL_NUMBER:
+    return a.as.number == b.as.number;
+  case VAL_BOOL:
+    return a.as.boolean == b.as.boolean;
+  case VAL_NIL:
+    return true;
+  case VAL_OBJ:
+    return a.as.obj == b.as.obj;
+  case VAL_EMPTY:
+    return false;
+  }
+
+  return false;
+}
+
+#endif
+
+char *vmake_value_type_to_string(vmake_value_type type);
 
-bool vmake_value_is_obj(vmake_value val);
 bool vmake_value_is_string(vmake_value val);
 bool vmake_value_is_native(vmake_value val);
 bool vmake_value_is_array(vmake_value val);
 bool vmake_value_is_instance(vmake_value val);
+bool vmake_value_is_table(vmake_value val);
 
 uint32_t vmake_value_hash(vmake_value val);
 
 char *vmake_value_to_string(vmake_value val);
 void vmake_value_print(vmake_value val);
-bool vmake_value_equals(vmake_value a, vmake_value b);
 int vmake_value_compare(vmake_value a, vmake_value b);
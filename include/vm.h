@@ -0,0 +1,29 @@
+#pragma once
+
+#include "chunk.h"
+#include "common.h"
+#include "value.h"
+#include <stdint.h>
+
+#define VMAKE_STACK_INITIAL_SIZE 256
+#define VMAKE_STACK_GROW_FACTOR 2
+
+typedef struct vmake_vm {
+  vmake_gen *gen;
+  // The VM that was running when this one started, which is waiting for an include to finish.
+  struct vmake_vm *enclosing;
+  vmake_chunk *chunk;
+  uint8_t *ip;
+  // The first byte of the instruction being executed, used to find the token errors are reported
+  // at.
+  uint8_t *instruction;
+  // The slot of each of the chunk's globals.
+  int *global_slots;
+  // The stack grows as needed, so pointers into it are only valid until the next push.
+  vmake_value *stack;
+  vmake_value *stack_top;
+  vmake_value *stack_end;
+} vmake_vm;
+
+// Runs the chunk that `gen` compiled.
+void vmake_vm_run(vmake_gen *gen);
@@ -4,35 +4,51 @@
 #include "scanner.h"
 #include <stdbool.h>
 
+typedef enum vmake_precedence {
+  PREC_NONE,
+  PREC_ASSIGNMENT,
+  PREC_EQUALITY,
+  PREC_COMPARISON,
+  PREC_TERM,
+  PREC_FACTOR,
+  PREC_UNARY,
+  PREC_CALL,
+} vmake_precedence;
+
+// Parses the rest of an expression after its first token has been consumed. `can_assign` tells
+// whether the expression may be the target of an assignment.
+typedef void (*vmake_parse_fn)(vmake_gen *gen, bool can_assign);
+
+// How to parse a token when it starts an expression (prefix), when it follows one (infix), and how
+// tightly it binds as an infix operator.
+typedef struct vmake_parse_rule {
+  vmake_parse_fn prefix;
+  vmake_parse_fn infix;
+  vmake_precedence precedence;
+} vmake_parse_rule;
+
 void declaration(vmake_gen *gen);
+// Declares a local with a statement of the form `local name = value;`.
+void local_declaration(vmake_gen *gen);
 void statement(vmake_gen *gen);
+void block(vmake_gen *gen);
 void print_statement(vmake_gen *gen);
-void include_statement(vmake_gen *gen);
+void include_statement(vmake_gen *gen, vmake_opcode op);
 void expression_statement(vmake_gen *gen);
-vmake_value expression(vmake_gen *gen);
-vmake_value assignment(vmake_gen *gen);
-vmake_value equality(vmake_gen *gen);
-vmake_value comparison(vmake_gen *gen);
-vmake_value term(vmake_gen *gen);
-vmake_value factor(vmake_gen *gen);
-vmake_value unary(vmake_gen *gen);
-vmake_value subscript(vmake_gen *gen);
-vmake_value call(vmake_gen *gen);
-vmake_value primary(vmake_gen *gen);
-vmake_arguments arguments(vmake_gen *gen);
-vmake_value grouping(vmake_gen *gen);
-vmake_value array(vmake_gen *gen);
-vmake_value number(vmake_gen *gen);
-vmake_value string(vmake_gen *gen);
-vmake_value identifier_variable(vmake_gen *gen);
+void expression(vmake_gen *gen);
+// Parses an expression whose operators bind at least as tightly as `precedence`.
+void parse_precedence(vmake_gen *gen, vmake_precedence precedence);
+void binary(vmake_gen *gen, bool can_assign);
+void unary(vmake_gen *gen, bool can_assign);
+void subscript(vmake_gen *gen, bool can_assign);
+void call(vmake_gen *gen, bool can_assign);
+void dot(vmake_gen *gen, bool can_assign);
+void literal(vmake_gen *gen, bool can_assign);
+void arguments(vmake_gen *gen, int *argc, int *kwargc);
+void grouping(vmake_gen *gen, bool can_assign);
+void array(vmake_gen *gen, bool can_assign);
+void number(vmake_gen *gen, bool can_assign);
+void string(vmake_gen *gen, bool can_assign);
+void identifier_variable(vmake_gen *gen, bool can_assign);
+// Returns the previous token as an interned string.
 vmake_value identifier_string(vmake_gen *gen);
-
-vmake_value assign_variable(vmake_gen *gen, vmake_value *lhs, vmake_value rhs);
-vmake_value call_native(vmake_gen *gen, vmake_value val, vmake_arguments *args);
-vmake_value call_method(vmake_gen *gen, vmake_value val, vmake_obj_instance *caller,
-                        vmake_arguments *args);
-vmake_value *resolve_variable(vmake_gen *gen, vmake_token name);
-vmake_value *resolve_local(vmake_gen *gen, vmake_token name);
-vmake_value *resolve_global(vmake_gen *gen, vmake_token name);
-vmake_value *create_local(vmake_gen *gen, vmake_token name);
-vmake_value *create_global(vmake_gen *gen, vmake_token name);
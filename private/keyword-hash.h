@@ -0,0 +1,19 @@
+#pragma once
+
+#include "scanner.h"
+#include <stdint.h>
+
+typedef struct vmake_keyword {
+  const char *name;
+  int length;
+  vmake_token_type type;
+} vmake_keyword;
+
+// The hash used for the keyword table. It only looks at the first character, the last character
+// and the length of an identifier, so it costs the same no matter how long the identifier is.
+// keyword-gen picks `seed` and `shift` so that no two keywords end up in the same slot.
+static inline uint32_t vmake_keyword_hash(const char *start, int length, uint32_t seed,
+                                          int shift) {
+  uint32_t key = (uint8_t)start[0] | (uint8_t)start[length - 1] << 8 | (uint32_t)length << 16;
+  return (key * seed) >> shift;
+}
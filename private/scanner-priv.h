@@ -4,15 +4,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-char *read_file(const char *path, size_t *file_size);
-
 bool is_identifier_char(char c, bool first);
 
 vmake_token make_number(vmake_scanner *scanner);
 vmake_token make_identifier(vmake_scanner *scanner);
 vmake_token make_string(vmake_scanner *scanner);
 vmake_token_type identifier_type(vmake_scanner *scanner);
-vmake_token_type check_keyword(vmake_scanner *scanner, int start, int length, const char *rest,
-                               vmake_token_type type);
+// Returns the type of the keyword spelled by the given characters, or TOKEN_IDENTIFIER if they
+// don't spell a keyword. Keywords are declared in keywords.def.
+vmake_token_type vmake_keyword_type(const char *start, int length);
 
 vmake_token make_token(vmake_scanner *scanner, vmake_token_type type);
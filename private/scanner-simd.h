@@ -0,0 +1,19 @@
+#pragma once
+
+// Block-scanning kernels used by the scanner to skip over runs of characters. Every kernel takes a
+// pointer `p` into a NUL-terminated source whose terminator is at `end`, and returns a pointer to
+// the first character that ends the run. Kernels never read past `end`, and treat the NUL byte as
+// the end of the run, like the rest of the scanner does.
+typedef struct vmake_scan_kernels {
+  // Skips spaces, tabs, carriage returns and newlines, adding the number of newlines to `lines`.
+  const char *(*skip_whitespace)(const char *p, const char *end, int *lines);
+  // Skips to the newline that ends a comment.
+  const char *(*skip_comment)(const char *p, const char *end);
+  // Skips to the '"' that ends a string.
+  const char *(*skip_string)(const char *p, const char *end);
+  // Skips the remaining characters of an identifier.
+  const char *(*skip_identifier)(const char *p, const char *end);
+} vmake_scan_kernels;
+
+// Returns the fastest kernels supported by the CPU we're running on: AVX2, SSE2, or plain C.
+const vmake_scan_kernels *vmake_scan_kernels_get(void);
@@ -0,0 +1,170 @@
+#include "arena.h"
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct vmake_arena_region {
+  alignas(VMAKE_ARENA_GRANULE) vmake_arena_region *next;
+};
+
+// Large allocations are linked in both directions so that they can be released on their own.
+struct vmake_arena_large {
+  alignas(VMAKE_ARENA_GRANULE) vmake_arena_large *next;
+  vmake_arena_large *prev;
+};
+
+// A released small allocation, linked into the free list of its size class.
+struct vmake_arena_slot {
+  vmake_arena_slot *next;
+};
+
+static size_t size_class(size_t size);
+static void *allocate_small(vmake_arena *arena, size_t class);
+static void *allocate_large(vmake_arena *arena, size_t size);
+static void *checked_malloc(size_t size);
+
+void vmake_arena_init(vmake_arena *arena) {
+  arena->regions = NULL;
+  arena->next = NULL;
+  arena->end = NULL;
+  for (int i = 0; i < VMAKE_ARENA_CLASS_COUNT; i++) {
+    arena->free_lists[i] = NULL;
+  }
+  arena->large = NULL;
+  arena->allocated = 0;
+}
+
+void vmake_arena_free(vmake_arena *arena) {
+  while (arena->regions != NULL) {
+    vmake_arena_region *next = arena->regions->next;
+    free(arena->regions);
+    arena->regions = next;
+  }
+  while (arena->large != NULL) {
+    vmake_arena_large *next = arena->large->next;
+    free(arena->large);
+    arena->large = next;
+  }
+  vmake_arena_init(arena);
+}
+
+void *vmake_arena_alloc(vmake_arena *arena, size_t size) {
+  if (size > VMAKE_ARENA_MAX_SMALL)
+    return allocate_large(arena, size);
+  return allocate_small(arena, size_class(size));
+}
+
+void *vmake_arena_realloc(vmake_arena *arena, void *ptr, size_t old_size, size_t new_size) {
+  if (ptr == NULL)
+    return vmake_arena_alloc(arena, new_size);
+
+  if (old_size > VMAKE_ARENA_MAX_SMALL && new_size > VMAKE_ARENA_MAX_SMALL) {
+    vmake_arena_large *large = (vmake_arena_large *)ptr - 1;
+    vmake_arena_large *moved = realloc(large, sizeof(vmake_arena_large) + new_size);
+    if (moved == NULL) {
+      fprintf(stderr, "Out of memory.\n");
+      exit(1);
+    }
+    if (moved->prev == NULL)
+      arena->large = moved;
+    else
+      moved->prev->next = moved;
+    if (moved->next != NULL)
+      moved->next->prev = moved;
+    arena->allocated += new_size - old_size;
+    return moved + 1;
+  }
+  if (old_size <= VMAKE_ARENA_MAX_SMALL && new_size <= VMAKE_ARENA_MAX_SMALL &&
+      size_class(old_size) == size_class(new_size))
+    return ptr;
+
+  void *resized = vmake_arena_alloc(arena, new_size);
+  memcpy(resized, ptr, old_size < new_size ? old_size : new_size);
+  vmake_arena_release(arena, ptr, old_size);
+  return resized;
+}
+
+void vmake_arena_release(vmake_arena *arena, void *ptr, size_t size) {
+  if (ptr == NULL)
+    return;
+
+  if (size > VMAKE_ARENA_MAX_SMALL) {
+    vmake_arena_large *large = (vmake_arena_large *)ptr - 1;
+    if (large->prev == NULL)
+      arena->large = large->next;
+    else
+      large->prev->next = large->next;
+    if (large->next != NULL)
+      large->next->prev = large->prev;
+    arena->allocated -= size;
+    free(large);
+    return;
+  }
+
+  size_t class = size_class(size);
+  vmake_arena_slot *node = ptr;
+  node->next = arena->free_lists[class];
+  arena->free_lists[class] = node;
+  arena->allocated -= (class + 1) * VMAKE_ARENA_GRANULE;
+}
+
+void vmake_arena_account(vmake_arena *arena, size_t old_size, size_t new_size) {
+  arena->allocated += new_size - old_size;
+}
+
+char *vmake_arena_strndup(vmake_arena *arena, const char *chars, size_t length) {
+  char *copy = vmake_arena_alloc(arena, length + 1);
+  memcpy(copy, chars, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+// Size classes are numbered from 0, for allocations of up to one granule.
+static size_t size_class(size_t size) {
+  return size == 0 ? 0 : (size - 1) / VMAKE_ARENA_GRANULE;
+}
+
+static void *allocate_small(vmake_arena *arena, size_t class) {
+  size_t size = (class + 1) * VMAKE_ARENA_GRANULE;
+  arena->allocated += size;
+
+  vmake_arena_slot *reused = arena->free_lists[class];
+  if (reused != NULL) {
+    arena->free_lists[class] = reused->next;
+    return reused;
+  }
+
+  if ((size_t)(arena->end - arena->next) < size) {
+    // What's left of the current region is lost, but it's less than a size class.
+    vmake_arena_region *region = checked_malloc(VMAKE_ARENA_REGION_SIZE);
+    region->next = arena->regions;
+    arena->regions = region;
+    arena->next = (char *)(region + 1);
+    arena->end = (char *)region + VMAKE_ARENA_REGION_SIZE;
+  }
+
+  void *ptr = arena->next;
+  arena->next += size;
+  return ptr;
+}
+
+static void *allocate_large(vmake_arena *arena, size_t size) {
+  vmake_arena_large *large = checked_malloc(sizeof(vmake_arena_large) + size);
+  large->prev = NULL;
+  large->next = arena->large;
+  if (arena->large != NULL)
+    arena->large->prev = large;
+  arena->large = large;
+  arena->allocated += size;
+  return large + 1;
+}
+
+static void *checked_malloc(size_t size) {
+  void *ptr = malloc(size);
+  if (ptr == NULL) {
+    fprintf(stderr, "Out of memory.\n");
+    exit(1);
+  }
+  return ptr;
+}
@@ -13,6 +13,13 @@ void vmake_value_array_free(vmake_value_array *arr) {
   vmake_value_array_new(arr);
 }
 
+void vmake_value_array_reserve(vmake_value_array *arr, int capacity) {
+  if (capacity > arr->capacity) {
+    arr->capacity = capacity;
+    arr->values = reallocarray(arr->values, arr->capacity, sizeof(vmake_value));
+  }
+}
+
 void vmake_value_array_push(vmake_value_array *arr, vmake_value val) {
   if (arr->size + 1 > arr->capacity) {
     arr->capacity = arr->capacity < 8 ? 8 : arr->capacity * 2;
@@ -0,0 +1,13 @@
+#include "atom.h"
+#include "common.h"
+#include "object.h"
+
+#define VMAKE_ATOM_SPELLING(id, spelling) [id] = spelling,
+static const char *const atom_spellings[] = {VMAKE_ATOMS(VMAKE_ATOM_SPELLING)};
+#undef VMAKE_ATOM_SPELLING
+
+void vmake_atoms_init(vmake_state *state) {
+  for (int i = 0; i < ATOM_T_MAX; i++) {
+    state->atoms[i] = vmake_obj_string_const(state, atom_spellings[i]);
+  }
+}
@@ -0,0 +1,430 @@
+#include "cache.h"
+#include "array.h"
+#include "hash.h"
+#include "object.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef VMAKE_VERSION
+#define VMAKE_VERSION "unknown"
+#endif
+
+#define CACHE_MAGIC "VMKC"
+// Every section of a cache file starts at a multiple of this, so that the arrays in it can be used
+// in place.
+#define CACHE_ALIGNMENT 8
+
+// A cache file is made of this header, followed by the token buffer (values, offsets, lengths,
+// lines and types), the code, the token of every byte of code, the constants followed by the names
+// of the globals, and finally the characters of the strings among them. Everything after the header
+// is the payload, which the header has a hash of.
+typedef struct cache_header {
+  char magic[4];
+  uint32_t format;
+  char version[16];
+  uint64_t source_hash;
+  uint64_t source_length;
+  uint32_t token_count;
+  uint32_t code_count;
+  uint32_t constant_count;
+  uint32_t global_count;
+  uint32_t strings_size;
+  uint32_t cache_count;
+  uint64_t payload_hash;
+} cache_header;
+
+typedef struct cache_constant {
+  uint32_t type;
+  // The length of string constants.
+  uint32_t length;
+  union {
+    double number;
+    struct {
+      // Offset of the characters in the string section.
+      uint32_t offset;
+      uint32_t hash;
+    } string;
+  } as;
+} cache_constant;
+
+static bool entry_path(char path[PATH_MAX], vmake_state *state, uint64_t hash);
+static void fill_header(cache_header *header, vmake_source *source, uint64_t hash);
+static bool valid_values(const cache_header *header, const cache_constant *values);
+static bool valid_tokens(const vmake_token_buffer *tokens, const vmake_source *source);
+static bool valid_code(const vmake_chunk *chunk, const cache_constant *constants,
+                       const cache_header *header);
+static uint32_t read_index(const uint8_t *operand);
+static size_t align(size_t size);
+static void write_section(FILE *fp, const void *data, size_t size);
+static vmake_source *map_file(const char *path);
+static vmake_value load_value(vmake_state *state, const cache_constant *constant,
+                              const char *strings);
+static bool store_value(cache_constant *constant, vmake_value val, uint32_t *strings_size);
+
+bool vmake_cache_load(vmake_state *state, vmake_source *source, uint64_t hash,
+                      vmake_token_buffer *tokens, vmake_chunk *chunk) {
+  if (state->cache_directory == NULL)
+    return false;
+
+  char path[PATH_MAX];
+  if (!entry_path(path, state, hash))
+    return false;
+  vmake_source *file = map_file(path);
+  if (file == NULL)
+    return false;
+
+  cache_header expected;
+  fill_header(&expected, source, hash);
+  const cache_header *header = (const cache_header *)file->chars;
+  if (file->length < sizeof(cache_header) ||
+      memcmp(header, &expected, offsetof(cache_header, token_count)) != 0) {
+    vmake_source_free(file);
+    return false;
+  }
+
+  size_t tokens_size = align(header->token_count * sizeof(vmake_token_value)) +
+                       3 * align(header->token_count * sizeof(uint32_t)) +
+                       align(header->token_count * sizeof(uint8_t));
+  size_t code_size = align(header->code_count * sizeof(uint8_t)) +
+                     align(header->code_count * sizeof(int));
+  size_t value_count = header->constant_count + header->global_count;
+  size_t size = align(sizeof(cache_header)) + tokens_size + code_size +
+                align(value_count * sizeof(cache_constant)) + header->strings_size;
+  size_t header_size = align(sizeof(cache_header));
+  if (file->length != size ||
+      vmake_hash_bytes(file->chars + header_size, size - header_size) != header->payload_hash) {
+    vmake_source_free(file);
+    return false;
+  }
+
+  const char *p = file->chars + align(sizeof(cache_header));
+  tokens->source = source->chars;
+  tokens->count = header->token_count;
+  tokens->capacity = header->token_count;
+  tokens->borrowed = true;
+  tokens->values = (vmake_token_value *)p;
+  p += align(header->token_count * sizeof(vmake_token_value));
+  tokens->offsets = (uint32_t *)p;
+  p += align(header->token_count * sizeof(uint32_t));
+  tokens->lengths = (uint32_t *)p;
+  p += align(header->token_count * sizeof(uint32_t));
+  tokens->lines = (uint32_t *)p;
+  p += align(header->token_count * sizeof(uint32_t));
+  tokens->types = (uint8_t *)p;
+  p += align(header->token_count * sizeof(uint8_t));
+
+  vmake_chunk_init(chunk);
+  chunk->count = header->code_count;
+  chunk->capacity = header->code_count;
+  chunk->cache_count = header->cache_count;
+  chunk->borrowed = true;
+  chunk->code = (uint8_t *)p;
+  p += align(header->code_count * sizeof(uint8_t));
+  chunk->tokens = (int *)p;
+  p += align(header->code_count * sizeof(int));
+
+  // The VM trusts the code it runs, so anything that indexes into something else is checked too,
+  // in case the file was written by a buggy vaq-make with the same format.
+  const cache_constant *values = (const cache_constant *)p;
+  if (!valid_values(header, values) || !valid_tokens(tokens, source) ||
+      !valid_code(chunk, values, header)) {
+    vmake_source_free(file);
+    return false;
+  }
+
+  const char *strings = p + align(value_count * sizeof(cache_constant));
+  vmake_value_array_reserve(&chunk->constants, header->constant_count);
+  for (uint32_t i = 0; i < header->constant_count; i++) {
+    vmake_value_array_push(&chunk->constants, load_value(state, &values[i], strings));
+  }
+  values += header->constant_count;
+  vmake_value_array_reserve(&chunk->globals, header->global_count);
+  for (uint32_t i = 0; i < header->global_count; i++) {
+    vmake_value_array_push(&chunk->globals, load_value(state, &values[i], strings));
+  }
+
+  file->next = state->sources;
+  state->sources = file;
+  return true;
+}
+
+bool vmake_cache_contains(vmake_state *state, uint64_t hash) {
+  if (state->cache_directory == NULL)
+    return false;
+
+  char path[PATH_MAX];
+  return entry_path(path, state, hash) && access(path, R_OK) == 0;
+}
+
+void vmake_cache_store(vmake_state *state, vmake_source *source, uint64_t hash,
+                       vmake_token_buffer *tokens, vmake_chunk *chunk) {
+  if (state->cache_directory == NULL)
+    return;
+
+  cache_header header;
+  fill_header(&header, source, hash);
+  header.token_count = tokens->count;
+  header.code_count = chunk->count;
+  header.cache_count = chunk->cache_count;
+  header.constant_count = chunk->constants.size;
+  header.global_count = chunk->globals.size;
+  header.strings_size = 0;
+
+  int value_count = chunk->constants.size + chunk->globals.size;
+  vmake_value *values = malloc(sizeof(vmake_value) * value_count);
+  memcpy(values, chunk->constants.values, sizeof(vmake_value) * chunk->constants.size);
+  memcpy(values + chunk->constants.size, chunk->globals.values,
+         sizeof(vmake_value) * chunk->globals.size);
+  cache_constant *constants = calloc(value_count, sizeof(cache_constant));
+  for (int i = 0; i < value_count; i++) {
+    if (!store_value(&constants[i], values[i], &header.strings_size)) {
+      free(constants);
+      free(values);
+      return;
+    }
+  }
+
+  // Write to a temporary file and rename it, so that a run that is interrupted, or that runs at the
+  // same time as another one, never leaves a truncated file behind.
+  char path[PATH_MAX];
+  char tmp_path[PATH_MAX];
+  FILE *fp = NULL;
+  if (entry_path(path, state, hash) &&
+      snprintf(tmp_path, PATH_MAX, "%s.%d.tmp", path, getpid()) < PATH_MAX) {
+    vmake_create_directory(state->cache_directory);
+    fp = fopen(tmp_path, "wb");
+  }
+  // The payload is built in memory first, since the header has its hash.
+  char *payload = NULL;
+  size_t payload_size = 0;
+  FILE *out = fp == NULL ? NULL : open_memstream(&payload, &payload_size);
+  if (out == NULL) {
+    if (fp != NULL) {
+      fclose(fp);
+      remove(tmp_path);
+    }
+    free(constants);
+    free(values);
+    return;
+  }
+
+  write_section(out, tokens->values, tokens->count * sizeof(vmake_token_value));
+  write_section(out, tokens->offsets, tokens->count * sizeof(uint32_t));
+  write_section(out, tokens->lengths, tokens->count * sizeof(uint32_t));
+  write_section(out, tokens->lines, tokens->count * sizeof(uint32_t));
+  write_section(out, tokens->types, tokens->count * sizeof(uint8_t));
+  write_section(out, chunk->code, chunk->count * sizeof(uint8_t));
+  write_section(out, chunk->tokens, chunk->count * sizeof(int));
+  write_section(out, constants, value_count * sizeof(cache_constant));
+  for (int i = 0; i < value_count; i++) {
+    if (constants[i].type != VAL_NUMBER) {
+      vmake_obj_string *str = (vmake_obj_string *)vmake_value_as_obj(values[i]);
+      fwrite(str->chars, 1, constants[i].length, out);
+    }
+  }
+  fclose(out);
+
+  header.payload_hash = vmake_hash_bytes(payload, payload_size);
+  write_section(fp, &header, sizeof(cache_header));
+  fwrite(payload, 1, payload_size, fp);
+  if (fclose(fp) == 0)
+    rename(tmp_path, path);
+  else
+    remove(tmp_path);
+
+  free(payload);
+  free(constants);
+  free(values);
+}
+
+static vmake_value load_value(vmake_state *state, const cache_constant *constant,
+                              const char *strings) {
+  if (constant->type == VAL_NUMBER)
+    return vmake_value_number(constant->as.number);
+
+  // Strings borrow their characters from the cache file, which is why it's kept loaded.
+  vmake_obj_string *str = vmake_obj_string_borrow(state, strings + constant->as.string.offset,
+                                                  constant->length, constant->as.string.hash);
+  return vmake_value_obj((vmake_obj *)str);
+}
+
+static bool store_value(cache_constant *constant, vmake_value val, uint32_t *strings_size) {
+  constant->type = vmake_value_get_type(val);
+  if (vmake_value_is_number(val)) {
+    constant->as.number = vmake_value_as_number(val);
+  } else if (vmake_value_is_string(val)) {
+    vmake_obj_string *str = (vmake_obj_string *)vmake_value_as_obj(val);
+    constant->length = str->length;
+    constant->as.string.offset = *strings_size;
+    constant->as.string.hash = str->hash;
+    *strings_size += str->length;
+  } else {
+    // The compiler only creates number and string constants.
+    return false;
+  }
+  return true;
+}
+
+// Returns false if the path is too long, in which case the file isn't cached.
+static bool entry_path(char path[PATH_MAX], vmake_state *state, uint64_t hash) {
+  return snprintf(path, PATH_MAX, "%s/%016llx.vmc", state->cache_directory,
+                  (unsigned long long)hash) < PATH_MAX;
+}
+
+static void fill_header(cache_header *header, vmake_source *source, uint64_t hash) {
+  // Zero the padding too, since headers are compared with memcmp.
+  memset(header, 0, sizeof(cache_header));
+  memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+  header->format = VMAKE_CACHE_FORMAT;
+  strncpy(header->version, VMAKE_VERSION, sizeof(header->version) - 1);
+  header->source_hash = hash;
+  header->source_length = source->length;
+}
+
+// Checks that constants are numbers or strings whose characters are in the string section, and that
+// the names of globals are strings.
+static bool valid_values(const cache_header *header, const cache_constant *values) {
+  uint32_t value_count = header->constant_count + header->global_count;
+  for (uint32_t i = 0; i < value_count; i++) {
+    const cache_constant *value = &values[i];
+    if (value->type == VAL_NUMBER && i < header->constant_count)
+      continue;
+    if (value->type != VAL_OBJ ||
+        (uint64_t)value->as.string.offset + value->length > header->strings_size)
+      return false;
+  }
+  return true;
+}
+
+static bool valid_tokens(const vmake_token_buffer *tokens, const vmake_source *source) {
+  for (int i = 0; i < tokens->count; i++) {
+    if (tokens->types[i] >= TOKEN_T_MAX ||
+        (uint64_t)tokens->offsets[i] + tokens->lengths[i] > source->length)
+      return false;
+  }
+  return true;
+}
+
+// Walks the instructions, checking that their operands are in the chunk and index into the tables
+// they refer to, and that the code ends with OP_RETURN, so that the VM never runs past it.
+static bool valid_code(const vmake_chunk *chunk, const cache_constant *constants,
+                       const cache_header *header) {
+  for (int i = 0; i < chunk->count; i++) {
+    if (chunk->tokens[i] < 0 || (uint32_t)chunk->tokens[i] >= header->token_count)
+      return false;
+  }
+
+  const uint8_t *code = chunk->code;
+  int i = 0;
+  while (i < chunk->count) {
+    uint8_t op = code[i++];
+    int operands;
+    switch (op) {
+    case OP_CONSTANT:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+      operands = 3;
+      break;
+    case OP_GET_PROPERTY:
+    case OP_GET_METHOD:
+      operands = 6;
+      break;
+    case OP_CALL:
+    case OP_INVOKE:
+    case OP_ARRAY:
+      operands = 2;
+      break;
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+      operands = 1;
+      break;
+    case OP_RETURN:
+      return i == chunk->count;
+    default:
+      if (op > OP_RETURN)
+        return false;
+      operands = 0;
+      break;
+    }
+    if (chunk->count - i < operands)
+      return false;
+
+    if (operands >= 3) {
+      uint32_t index = read_index(&code[i]);
+      if (op == OP_GET_GLOBAL || op == OP_SET_GLOBAL) {
+        if (index >= header->global_count)
+          return false;
+      } else if (index >= header->constant_count) {
+        return false;
+      }
+      // Property names are looked up as strings.
+      if (operands == 6 &&
+          (constants[index].type != VAL_OBJ || read_index(&code[i + 3]) >= header->cache_count))
+        return false;
+    }
+    i += operands;
+  }
+  return false;
+}
+
+static uint32_t read_index(const uint8_t *operand) {
+  return (uint32_t)operand[0] << 16 | operand[1] << 8 | operand[2];
+}
+
+static size_t align(size_t size) { return (size + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1); }
+
+static void write_section(FILE *fp, const void *data, size_t size) {
+  static const char padding[CACHE_ALIGNMENT] = {0};
+  fwrite(data, 1, size, fp);
+  fwrite(padding, 1, align(size) - size, fp);
+}
+
+static vmake_source *map_file(const char *path) {
+  int fd = open(path, O_RDONLY);
+  struct stat file_stat;
+  if (fd == -1)
+    return NULL;
+  if (fstat(fd, &file_stat) == -1 || file_stat.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  vmake_source *file = malloc(sizeof(vmake_source));
+  file->length = file_stat.st_size;
+  file->mapped = false;
+  file->next = NULL;
+
+#ifdef VMAKE_USE_MMAP
+  void *mapping = mmap(NULL, file->length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping != MAP_FAILED) {
+    file->chars = mapping;
+    file->mapped = true;
+  }
+#endif
+
+  if (!file->mapped) {
+    char *chars = malloc(file->length);
+    size_t bytes_read = 0;
+    while (bytes_read < file->length) {
+      ssize_t n = read(fd, chars + bytes_read, file->length - bytes_read);
+      if (n <= 0)
+        break;
+      bytes_read += n;
+    }
+    file->chars = chars;
+    if (bytes_read != file->length) {
+      close(fd);
+      vmake_source_free(file);
+      return NULL;
+    }
+  }
+
+  close(fd);
+  return file;
+}
@@ -0,0 +1,49 @@
+#include "chunk.h"
+#include <stdlib.h>
+
+void vmake_chunk_init(vmake_chunk *chunk) {
+  chunk->code = NULL;
+  chunk->tokens = NULL;
+  chunk->count = 0;
+  chunk->capacity = 0;
+  chunk->borrowed = false;
+  chunk->caches = NULL;
+  chunk->cache_count = 0;
+  vmake_value_array_new(&chunk->constants);
+  vmake_value_array_new(&chunk->globals);
+}
+
+void vmake_chunk_free(vmake_chunk *chunk) {
+  if (!chunk->borrowed) {
+    free(chunk->code);
+    free(chunk->tokens);
+  }
+  free(chunk->caches);
+  vmake_value_array_free(&chunk->constants);
+  vmake_value_array_free(&chunk->globals);
+  vmake_chunk_init(chunk);
+}
+
+void vmake_chunk_write(vmake_chunk *chunk, uint8_t byte, int token) {
+  if (chunk->count + 1 > chunk->capacity) {
+    chunk->capacity = chunk->capacity < 8 ? 8 : chunk->capacity * 2;
+    chunk->code = reallocarray(chunk->code, chunk->capacity, sizeof(uint8_t));
+    chunk->tokens = reallocarray(chunk->tokens, chunk->capacity, sizeof(int));
+  }
+
+  chunk->code[chunk->count] = byte;
+  chunk->tokens[chunk->count] = token;
+  chunk->count++;
+}
+
+int vmake_chunk_add_constant(vmake_chunk *chunk, vmake_value value) {
+  vmake_value_array_push(&chunk->constants, value);
+  return chunk->constants.size - 1;
+}
+
+int vmake_chunk_add_global(vmake_chunk *chunk, vmake_value name) {
+  vmake_value_array_push(&chunk->globals, name);
+  return chunk->globals.size - 1;
+}
+
+int vmake_chunk_add_cache(vmake_chunk *chunk) { return chunk->cache_count++; }
@@ -53,6 +53,8 @@ void vmake_build_makefiles(vmake_state *state, char *build_directory, char *sour
       fprintf(main.fp, ".PHONY: %s\n\n", target.name);
 
       vmake_string_buf_append(&target_rules, " %s", target.name);
+      free(target.name);
+      free(target.dir_path);
     }
   }
   fprintf(main.fp, "all:%s\n", target_rules.string);
@@ -80,16 +82,18 @@ static vmake_makefile create_file_for_target(vmake_state *state, char *name) {
   char *file_path = malloc(sizeof(char) * (dir_path_len + strlen("/build.make") + 1));
   sprintf(file_path, "%s/build.make", makefile.dir_path);
   makefile.fp = vmake_new_makefile(file_path);
+  free(file_path);
+  // The makefile owns name, which is freed along with dir_path once the target is written.
   makefile.name = name;
 
   return makefile;
 }
 
 static vmake_makefile build_target(vmake_state *state, vmake_value target) {
-  if (target.type == VAL_OBJ) {
-    switch (target.as.obj->type) {
+  if (vmake_value_is_obj(target)) {
+    switch (vmake_value_as_obj(target)->type) {
     case OBJ_INSTANCE: {
-      vmake_obj_instance *inst = ((vmake_obj_instance *)target.as.obj);
+      vmake_obj_instance *inst = ((vmake_obj_instance *)vmake_value_as_obj(target));
       if (inst->klass == state->classes[CLASS_EXECUTABLE]) {
         return build_executable(state, inst);
       } else {
@@ -102,34 +106,37 @@ static vmake_makefile build_target(vmake_state *state, vmake_value target) {
     }
     default:
       vmake_error(NULL, CTX_INTERNAL, NULL, "Tried building target of unknown type %s.",
-                  vmake_obj_type_to_string(target.as.obj->type));
+                  vmake_obj_type_to_string(vmake_value_as_obj(target)->type));
       return NULL_MAKEFILE;
     }
   } else {
     vmake_error(NULL, CTX_INTERNAL, NULL, "Tried building target of unknown type %s.",
-                vmake_value_type_to_string(target.type));
+                vmake_value_type_to_string(vmake_value_get_type(target)));
     return NULL_MAKEFILE;
   }
 }
 
 static vmake_makefile build_executable(vmake_state *state, vmake_obj_instance *inst) {
-  char *name =
-      ((vmake_obj_string *)vmake_obj_instance_get_field(inst, state, "name").as.obj)->chars;
+  vmake_obj_string *name_str =
+      (vmake_obj_string *)vmake_value_as_obj(vmake_obj_instance_get_field(inst, state, ATOM_NAME));
+  char *name = strndup(name_str->chars, name_str->length);
   vmake_makefile file = create_file_for_target(state, name);
 
-  vmake_value_array *sources =
-      ((vmake_obj_array *)vmake_obj_instance_get_field(inst, state, "sources").as.obj)->array;
+  vmake_value sources_val = vmake_obj_instance_get_field(inst, state, ATOM_SOURCES);
+  const vmake_value_array *sources =
+      vmake_obj_array_values((vmake_obj_array *)vmake_value_as_obj(sources_val));
 
   {
-    vmake_value val = vmake_obj_instance_get_field(inst, state, "include_directories");
-    if (val.type != VAL_NIL) {
-      vmake_value_array *inc_dirs = ((vmake_obj_array *)val.as.obj)->array;
+    vmake_value val = vmake_obj_instance_get_field(inst, state, ATOM_INCLUDE_DIRECTORIES);
+    if (!vmake_value_is_nil(val)) {
+      const vmake_value_array *inc_dirs =
+          vmake_obj_array_values((vmake_obj_array *)vmake_value_as_obj(val));
       for (int i = 0; i < inc_dirs->size; i++) {
         if (!vmake_value_is_string(sources->values[i]))
           vmake_error_exit(NULL, CTX_INTERNAL, NULL,
                            "Expected string in executable include directories.");
         fprintf(file.fp, "CFLAGS += -I%s\n",
-                ((vmake_obj_string *)inc_dirs->values[i].as.obj)->chars);
+                ((vmake_obj_string *)vmake_value_as_obj(inc_dirs->values[i]))->chars);
       }
       if (inc_dirs->size > 0)
         fprintf(file.fp, "\n");
@@ -137,14 +144,16 @@ static vmake_makefile build_executable(vmake_state *state, vmake_obj_instance *i
   }
 
   {
-    vmake_value val = vmake_obj_instance_get_field(inst, state, "link_libraries");
-    if (val.type != VAL_NIL) {
-      vmake_value_array *libs = ((vmake_obj_array *)val.as.obj)->array;
+    vmake_value val = vmake_obj_instance_get_field(inst, state, ATOM_LINK_LIBRARIES);
+    if (!vmake_value_is_nil(val)) {
+      const vmake_value_array *libs =
+          vmake_obj_array_values((vmake_obj_array *)vmake_value_as_obj(val));
       for (int i = 0; i < libs->size; i++) {
         if (!vmake_value_is_string(sources->values[i]))
           vmake_error_exit(NULL, CTX_INTERNAL, NULL,
                            "Expected string in executable link libraries.");
-        fprintf(file.fp, "LIBS += -l%s\n", ((vmake_obj_string *)libs->values[i].as.obj)->chars);
+        vmake_obj_string *lib = (vmake_obj_string *)vmake_value_as_obj(libs->values[i]);
+        fprintf(file.fp, "LIBS += -l%.*s\n", lib->length, lib->chars);
       }
       if (libs->size > 0)
         fprintf(file.fp, "\n");
@@ -158,7 +167,7 @@ static vmake_makefile build_executable(vmake_state *state, vmake_obj_instance *i
   for (int i = 0; i < sources->size; i++) {
     if (!vmake_value_is_string(sources->values[i]))
       vmake_error_exit(NULL, CTX_INTERNAL, NULL, "Expected string in executable sources.");
-    char *source_str = ((vmake_obj_string *)sources->values[i].as.obj)->chars;
+    char *source_str = ((vmake_obj_string *)vmake_value_as_obj(sources->values[i]))->chars;
     char *source_path_rel = vmake_path_rel(state->make.source_directory, source_str);
     char *source_path = realpath(source_path_rel, NULL);
     free(source_path_rel);
@@ -195,11 +204,15 @@ static vmake_makefile build_executable(vmake_state *state, vmake_obj_instance *i
 
   int loop_end = sources->size <= objects_len ? sources->size : objects_len;
   for (int i = 0; i < loop_end; i++) {
-    char *source_str = ((vmake_obj_string *)sources->values[i].as.obj)->chars;
+    char *source_str = ((vmake_obj_string *)vmake_value_as_obj(sources->values[i]))->chars;
     fprintf(file.fp, "%s: %s\n", objects[i], source_str);
     fprintf(file.fp, "\t$(CC) -c $(CFLAGS) $^ -o $@\n");
   }
   fprintf(file.fp, "\n");
 
+  for (int i = 0; i < objects_len; i++)
+    free(objects[i]);
+  free(objects);
+
   return file;
 }
@@ -1,11 +1,15 @@
 #include "file.h"
 #include "common.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+static char *read_source(int fd, const char *path, size_t size);
+
 char *vmake_path_abs(const char *path) { return realpath(path, NULL); }
 
 char *vmake_path_rel(const char *current, const char *relative) {
@@ -73,8 +77,9 @@ char *vmake_path_abs_to_rel(const char *abs) {
         previous_dir_index = i;
     }
 
+    // Every directory of the working directory below the common one is a "../".
     int dir_count = 1;
-    for (const char *p = abs + previous_dir_index + 1; *p != '\0'; p++) {
+    for (const char *p = cwd + previous_dir_index + 1; *p != '\0'; p++) {
       if (*p == '/')
         dir_count++;
     }
@@ -86,13 +91,91 @@ char *vmake_path_abs_to_rel(const char *abs) {
       memcpy(res + pos, "../", 3);
       pos += 3;
     }
-    strcat(res, abs + previous_dir_index + 1);
+    strcpy(res + pos, abs + previous_dir_index + 1);
 
     free(cwd);
     return res;
   }
 }
 
+vmake_source *vmake_source_load(const char *path) {
+  vmake_source *source = vmake_source_open(path);
+  if (source == NULL) {
+    fprintf(stderr,
+            "An error occurred while trying to open file at '%s'. The file either doesn't exist or "
+            "requires elevated permissions.\n",
+            path);
+    exit(1);
+  }
+  return source;
+}
+
+vmake_source *vmake_source_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  struct stat file_stat;
+  if (fd == -1)
+    return NULL;
+  if (fstat(fd, &file_stat) == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  vmake_source *source = malloc(sizeof(vmake_source));
+  source->length = file_stat.st_size;
+  source->mapped = false;
+  source->next = NULL;
+
+#ifdef VMAKE_USE_MMAP
+  // The bytes between the end of the file and the end of the last mapped page are guaranteed to be
+  // zero, which gives us the NUL terminator for free. If the file fills its last page exactly
+  // there's no such byte, so we fall back to reading the file.
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (source->length > 0 && source->length % page_size != 0) {
+    void *mapping = mmap(NULL, source->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, source->length, MADV_SEQUENTIAL);
+      source->chars = mapping;
+      source->mapped = true;
+    }
+  }
+#endif
+
+  if (!source->mapped)
+    source->chars = read_source(fd, path, source->length);
+
+  close(fd);
+  return source;
+}
+
+void vmake_source_free(vmake_source *source) {
+  if (source->mapped)
+    munmap((void *)source->chars, source->length);
+  else
+    free((void *)source->chars);
+  free(source);
+}
+
+static char *read_source(int fd, const char *path, size_t size) {
+  char *chars = malloc(sizeof(char) * (size + 1));
+  if (chars == NULL) {
+    fprintf(stderr, "Could not allocate buffer to store file at \"%s\"\n", path);
+    exit(1);
+  }
+
+  size_t bytes_read = 0;
+  while (bytes_read < size) {
+    ssize_t n = read(fd, chars + bytes_read, size - bytes_read);
+    if (n <= 0) {
+      fprintf(stderr, "Could not read file at '%s'\n", path);
+      exit(1);
+    }
+    bytes_read += n;
+  }
+  chars[bytes_read] = '\0';
+
+  return chars;
+}
+
 void vmake_create_directory(const char *path) {
   int path_len = strlen(path);
   for (int i = 0; i < path_len; i++) {
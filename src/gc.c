@@ -0,0 +1,200 @@
+#include "gc.h"
+#include "common.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
+#include <stdlib.h>
+
+static void mark_roots(vmake_state *state);
+static void mark_array(vmake_gc *gc, const vmake_value_array *arr);
+static void mark_table(vmake_gc *gc, vmake_table *table);
+static void trace_references(vmake_gc *gc);
+static void blacken(vmake_gc *gc, vmake_obj *obj);
+static void remove_white_strings(vmake_interner *strings);
+static void sweep(vmake_state *state);
+
+void vmake_gc_init(vmake_gc *gc) {
+  gc->stats.allocated = 0;
+  gc->stats.threshold = VMAKE_GC_INITIAL_THRESHOLD;
+  gc->stats.collections = 0;
+  gc->stats.freed_bytes = 0;
+  gc->stats.freed_objects = 0;
+  gc->gray = NULL;
+  gc->gray_count = 0;
+  gc->gray_capacity = 0;
+}
+
+void vmake_gc_free(vmake_gc *gc) {
+  free(gc->gray);
+  vmake_gc_init(gc);
+}
+
+void vmake_gc_safepoint(vmake_state *state) {
+#ifdef VMAKE_GC_STRESS
+  vmake_gc_collect(state);
+#else
+  if (state->arena.allocated > state->gc.stats.threshold)
+    vmake_gc_collect(state);
+#endif
+}
+
+void vmake_gc_collect(vmake_state *state) {
+  vmake_gc *gc = &state->gc;
+  size_t before = state->arena.allocated;
+
+  mark_roots(state);
+  trace_references(gc);
+  remove_white_strings(&state->strings);
+  sweep(state);
+
+  gc->stats.allocated = state->arena.allocated;
+  gc->stats.threshold = state->arena.allocated * VMAKE_GC_GROW_FACTOR;
+  if (gc->stats.threshold < VMAKE_GC_INITIAL_THRESHOLD)
+    gc->stats.threshold = VMAKE_GC_INITIAL_THRESHOLD;
+  gc->stats.freed_bytes += before - state->arena.allocated;
+  gc->stats.collections++;
+}
+
+void vmake_gc_mark_value(vmake_gc *gc, vmake_value val) {
+  if (vmake_value_is_obj(val))
+    vmake_gc_mark_obj(gc, vmake_value_as_obj(val));
+}
+
+void vmake_gc_mark_obj(vmake_gc *gc, vmake_obj *obj) {
+  if (obj == NULL || obj->marked)
+    return;
+  obj->marked = true;
+
+  if (gc->gray_count == gc->gray_capacity) {
+    gc->gray_capacity =
+        gc->gray_capacity == 0 ? VMAKE_GC_GRAY_INITIAL_SIZE : gc->gray_capacity * 2;
+    gc->gray = reallocarray(gc->gray, gc->gray_capacity, sizeof(vmake_obj *));
+  }
+  gc->gray[gc->gray_count++] = obj;
+}
+
+static void mark_roots(vmake_state *state) {
+  vmake_gc *gc = &state->gc;
+  mark_array(gc, &state->global_values);
+  mark_table(gc, &state->globals);
+  mark_array(gc, &state->make.targets);
+  for (int i = 0; i < CLASS_T_MAX; i++) {
+    vmake_gc_mark_obj(gc, (vmake_obj *)state->classes[i]);
+  }
+  for (int i = 0; i < ATOM_T_MAX; i++) {
+    vmake_gc_mark_obj(gc, (vmake_obj *)state->atoms[i]);
+  }
+
+  // Modules are kept for as long as the state, so their constants are too.
+  for (int i = 0; i < state->modules.count; i++) {
+    vmake_module *module = state->modules.modules[i];
+    mark_table(gc, &module->includes);
+    if (module->compiled)
+      mark_array(gc, &module->chunk.constants);
+  }
+
+  for (vmake_vm *vm = state->vm; vm != NULL; vm = vm->enclosing) {
+    for (vmake_value *slot = vm->stack; slot < vm->stack_top; slot++) {
+      vmake_gc_mark_value(gc, *slot);
+    }
+  }
+}
+
+static void mark_array(vmake_gc *gc, const vmake_value_array *arr) {
+  for (int i = 0; i < arr->size; i++) {
+    vmake_gc_mark_value(gc, arr->values[i]);
+  }
+}
+
+static void mark_table(vmake_gc *gc, vmake_table *table) {
+  for (int i = 0; i < table->entry_count; i++) {
+    vmake_table_entry *entry = vmake_table_entry_at(table, i);
+    if (vmake_value_is_empty(entry->key))
+      continue;
+    vmake_gc_mark_value(gc, entry->key);
+    vmake_gc_mark_value(gc, entry->value);
+  }
+}
+
+static void trace_references(vmake_gc *gc) {
+  while (gc->gray_count > 0) {
+    blacken(gc, gc->gray[--gc->gray_count]);
+  }
+}
+
+static void blacken(vmake_gc *gc, vmake_obj *obj) {
+  switch (obj->type) {
+  case OBJ_STRING:
+    break;
+  case OBJ_ROPE: {
+    vmake_obj_rope *rope = (vmake_obj_rope *)obj;
+    vmake_gc_mark_obj(gc, rope->left);
+    vmake_gc_mark_obj(gc, rope->right);
+    vmake_gc_mark_obj(gc, (vmake_obj *)rope->flat);
+    break;
+  }
+  case OBJ_NATIVE:
+    vmake_gc_mark_obj(gc, (vmake_obj *)((vmake_obj_native *)obj)->name);
+    break;
+  case OBJ_ARRAY:
+    mark_array(gc, vmake_obj_array_values((vmake_obj_array *)obj));
+    break;
+  case OBJ_CLASS: {
+    vmake_obj_class *klass = (vmake_obj_class *)obj;
+    vmake_gc_mark_obj(gc, (vmake_obj *)klass->name);
+    mark_table(gc, &klass->methods);
+    vmake_gc_mark_obj(gc, (vmake_obj *)klass->shape);
+    break;
+  }
+  case OBJ_INSTANCE: {
+    vmake_obj_instance *inst = (vmake_obj_instance *)obj;
+    vmake_gc_mark_obj(gc, (vmake_obj *)inst->klass);
+    vmake_gc_mark_obj(gc, (vmake_obj *)inst->shape);
+    vmake_gc_mark_obj(gc, (vmake_obj *)inst->properties);
+    for (int i = 0; i < inst->shape->field_count; i++) {
+      vmake_gc_mark_value(gc, inst->fields[i]);
+    }
+    break;
+  }
+  case OBJ_METHOD:
+    vmake_gc_mark_obj(gc, (vmake_obj *)((vmake_obj_method *)obj)->name);
+    break;
+  case OBJ_TABLE:
+    mark_table(gc, vmake_obj_table_entries((vmake_obj_table *)obj));
+    break;
+  case OBJ_SHAPE: {
+    // Shapes are kept for as long as their class, since inline caches may point to any of them.
+    vmake_obj_shape *shape = (vmake_obj_shape *)obj;
+    for (int i = 0; i < shape->field_count; i++) {
+      vmake_gc_mark_obj(gc, (vmake_obj *)shape->names[i]);
+    }
+    for (vmake_obj_shape *child = shape->children; child != NULL; child = child->next_sibling) {
+      vmake_gc_mark_obj(gc, (vmake_obj *)child);
+    }
+    break;
+  }
+  }
+}
+
+static void remove_white_strings(vmake_interner *strings) {
+  for (int i = 0; i < strings->string_count; i++) {
+    vmake_obj_string *str = strings->strings[i];
+    if (str != NULL && !str->obj.marked)
+      vmake_interner_remove(strings, str);
+  }
+}
+
+static void sweep(vmake_state *state) {
+  vmake_obj **link = &state->objects;
+  while (*link != NULL) {
+    vmake_obj *obj = *link;
+    if (obj->marked) {
+      obj->marked = false;
+      link = &obj->next;
+    } else {
+      *link = obj->next;
+      vmake_obj_free(state, obj);
+      state->gc.stats.freed_objects++;
+    }
+  }
+}
@@ -0,0 +1,147 @@
+#include "interner.h"
+#include "object.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOT_EMPTY -1
+#define SLOT_DELETED -2
+#define INITIAL_CAPACITY 64
+
+static int find_slot(vmake_interner *interner, vmake_obj_string *str);
+static void insert_slot(vmake_interner *interner, uint32_t hash, int index);
+static void rehash(vmake_interner *interner, int new_capacity);
+
+void vmake_interner_init(vmake_interner *interner) {
+  interner->count = 0;
+  interner->capacity = 0;
+  interner->deleted = 0;
+  interner->slots = NULL;
+  interner->strings = NULL;
+  interner->string_count = 0;
+  interner->string_capacity = 0;
+  interner->pages = NULL;
+  interner->page_count = 0;
+  interner->next = NULL;
+  interner->end = NULL;
+  interner->page_bytes = 0;
+}
+
+void vmake_interner_free(vmake_interner *interner) {
+  for (int i = 0; i < interner->page_count; i++) {
+    free(interner->pages[i]);
+  }
+  free(interner->pages);
+  free(interner->slots);
+  free(interner->strings);
+  vmake_interner_init(interner);
+}
+
+vmake_obj_string *vmake_interner_find(vmake_interner *interner, const char *chars, int length,
+                                      uint32_t hash) {
+  if (interner->count == 0)
+    return NULL;
+
+  uint32_t mask = interner->capacity - 1;
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    vmake_interner_slot slot = interner->slots[i];
+    if (slot.index == SLOT_EMPTY)
+      return NULL;
+    if (slot.index >= 0 && slot.hash == hash) {
+      vmake_obj_string *str = interner->strings[slot.index];
+      if (str->length == length && memcmp(str->chars, chars, length) == 0)
+        return str;
+    }
+  }
+}
+
+void vmake_interner_add(vmake_interner *interner, vmake_obj_string *str) {
+  if ((interner->count + interner->deleted + 1) * VMAKE_INTERNER_MAX_LOAD_DEN >
+      interner->capacity * VMAKE_INTERNER_MAX_LOAD_NUM) {
+    // Tables that are mostly tombstones are rehashed at the same size instead of growing.
+    int capacity = interner->capacity == 0 ? INITIAL_CAPACITY : interner->capacity;
+    if ((interner->count + 1) * 2 > capacity)
+      capacity = interner->capacity == 0 ? capacity : capacity * 2;
+    rehash(interner, capacity);
+  }
+
+  if (interner->string_count == interner->string_capacity) {
+    interner->string_capacity = interner->string_capacity == 0 ? INITIAL_CAPACITY
+                                                               : interner->string_capacity * 2;
+    interner->strings = reallocarray(interner->strings, interner->string_capacity,
+                                     sizeof(vmake_obj_string *));
+  }
+  interner->strings[interner->string_count] = str;
+  insert_slot(interner, str->hash, interner->string_count++);
+  interner->count++;
+}
+
+void vmake_interner_remove(vmake_interner *interner, vmake_obj_string *str) {
+  int i = find_slot(interner, str);
+  interner->strings[interner->slots[i].index] = NULL;
+  interner->slots[i].index = SLOT_DELETED;
+  interner->count--;
+  interner->deleted++;
+}
+
+char *vmake_interner_copy_chars(vmake_interner *interner, const char *chars, int length) {
+  size_t size = (size_t)length + 1;
+  if ((size_t)(interner->end - interner->next) < size) {
+    // What's left of the current page is abandoned, which wastes little since strings are small
+    // compared to pages.
+    size_t page_size = size > VMAKE_INTERNER_PAGE_SIZE ? size : VMAKE_INTERNER_PAGE_SIZE;
+    interner->pages = reallocarray(interner->pages, interner->page_count + 1, sizeof(char *));
+    interner->next = interner->pages[interner->page_count++] = malloc(page_size);
+    interner->end = interner->next + page_size;
+    interner->page_bytes += page_size;
+  }
+
+  char *copy = interner->next;
+  memcpy(copy, chars, length);
+  copy[length] = '\0';
+  interner->next += size;
+  return copy;
+}
+
+// Returns the slot of `str`, which must be interned.
+static int find_slot(vmake_interner *interner, vmake_obj_string *str) {
+  uint32_t mask = interner->capacity - 1;
+  for (uint32_t i = str->hash & mask;; i = (i + 1) & mask) {
+    int index = interner->slots[i].index;
+    if (index >= 0 && interner->strings[index] == str)
+      return i;
+  }
+}
+
+// Puts `index` in the first free slot for `hash`, without checking whether it's already there.
+static void insert_slot(vmake_interner *interner, uint32_t hash, int index) {
+  uint32_t mask = interner->capacity - 1;
+  uint32_t i = hash & mask;
+  while (interner->slots[i].index >= 0) {
+    i = (i + 1) & mask;
+  }
+  if (interner->slots[i].index == SLOT_DELETED)
+    interner->deleted--;
+  interner->slots[i].hash = hash;
+  interner->slots[i].index = index;
+}
+
+static void rehash(vmake_interner *interner, int new_capacity) {
+  free(interner->slots);
+  interner->slots = malloc(sizeof(vmake_interner_slot) * new_capacity);
+  for (int i = 0; i < new_capacity; i++) {
+    interner->slots[i].index = SLOT_EMPTY;
+  }
+  interner->capacity = new_capacity;
+  interner->deleted = 0;
+
+  // Removed strings are dropped from the array, so the remaining ones get new indices.
+  int count = 0;
+  for (int i = 0; i < interner->string_count; i++) {
+    vmake_obj_string *str = interner->strings[i];
+    if (str == NULL)
+      continue;
+    interner->strings[count] = str;
+    insert_slot(interner, str->hash, count++);
+  }
+  interner->string_count = count;
+}
@@ -0,0 +1,342 @@
+#include "module.h"
+#include "cache.h"
+#include "common.h"
+#include "file.h"
+#include "hash.h"
+#include "object.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef VMAKE_PARALLEL_INCLUDES
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+// Prepares the levels of the include graph one after the other. With VMAKE_PARALLEL_INCLUDES, the
+// workers are started for the first level with more than one module, and then wait for the next
+// level until vmake_module_prepare is done.
+typedef struct prepare_pool {
+  vmake_state *state;
+  // The modules of the current level.
+  vmake_module **modules;
+  int count;
+#ifdef VMAKE_PARALLEL_INCLUDES
+  // The index of the next module to prepare, shared by the workers.
+  atomic_int next;
+  pthread_t *workers;
+  int worker_count;
+  pthread_mutex_t lock;
+  // Signaled when a level is ready, or when the workers should stop.
+  pthread_cond_t ready;
+  // Signaled when the last worker is done with a level.
+  pthread_cond_t done;
+  // Bumped for every level, so that workers know when there's a new one.
+  int level;
+  // The number of workers still busy with the current level.
+  int busy;
+  bool stopping;
+#endif
+} prepare_pool;
+
+static uint64_t hash_file(dev_t dev, ino_t ino);
+static int *find_bucket(vmake_module_table *table, dev_t dev, ino_t ino);
+static void grow_table(vmake_module_table *table);
+static void run_level(prepare_pool *pool, vmake_module **modules, int count);
+static void prepare_module(vmake_state *state, vmake_module *module);
+static void find_includes(vmake_state *state, vmake_module *module, vmake_module ***found,
+                          int *count, int *capacity);
+#ifdef VMAKE_PARALLEL_INCLUDES
+static void start_workers(prepare_pool *pool);
+static void stop_workers(prepare_pool *pool);
+static void prepare_modules(prepare_pool *pool);
+static void *prepare_worker(void *arg);
+#endif
+
+void vmake_module_table_init(vmake_module_table *table) {
+  table->modules = NULL;
+  table->count = 0;
+  table->capacity = 0;
+  table->buckets = NULL;
+}
+
+void vmake_module_table_free(vmake_module_table *table) {
+  for (int i = 0; i < table->count; i++) {
+    vmake_module *module = table->modules[i];
+    if (module->compiled)
+      vmake_chunk_free(&module->chunk);
+    if (module->scanned)
+      vmake_token_buffer_free(&module->tokens);
+    vmake_table_free(&module->includes);
+    free(module->path);
+    free(module);
+  }
+  free(table->modules);
+  free(table->buckets);
+  vmake_module_table_init(table);
+}
+
+vmake_module *vmake_module_get(vmake_module_table *table, const char *path) {
+  struct stat file_stat;
+  if (stat(path, &file_stat) == -1)
+    return NULL;
+
+  if (table->count == table->capacity)
+    grow_table(table);
+
+  int *bucket = find_bucket(table, file_stat.st_dev, file_stat.st_ino);
+  if (*bucket != -1)
+    return table->modules[*bucket];
+
+  vmake_module *module = malloc(sizeof(vmake_module));
+  module->path = strdup(path);
+  module->dev = file_stat.st_dev;
+  module->ino = file_stat.st_ino;
+  module->index = table->count;
+  module->source = NULL;
+  module->hash = 0;
+  module->scanned = false;
+  module->compiled = false;
+  module->prepared = false;
+  vmake_table_init(&module->includes);
+  module->included_from = NULL;
+  module->active = false;
+  module->run_count = 0;
+
+  table->modules[table->count++] = module;
+  *bucket = module->index;
+  return module;
+}
+
+void vmake_module_load(vmake_state *state, vmake_module *module) {
+  if (module->source == NULL) {
+    module->source = vmake_source_load(module->path);
+    module->source->next = state->sources;
+    state->sources = module->source;
+    module->hash = vmake_hash_bytes(module->source->chars, module->source->length);
+  }
+
+  if (!module->scanned) {
+    if (vmake_cache_load(state, module->source, module->hash, &module->tokens, &module->chunk))
+      module->compiled = true;
+    else
+      vmake_token_buffer_scan(&module->tokens, module->source->chars, module->source->length);
+    module->scanned = true;
+  }
+}
+
+void vmake_module_prepare(vmake_state *state, vmake_module *root) {
+  vmake_module **level = malloc(sizeof(vmake_module *));
+  int count = 1;
+  level[0] = root;
+  root->prepared = true;
+  prepare_pool pool;
+  pool.state = state;
+#ifdef VMAKE_PARALLEL_INCLUDES
+  pool.workers = NULL;
+  pool.worker_count = 0;
+#endif
+
+  // The include graph is walked one level at a time: the files of a level are loaded and scanned
+  // together, and the includes found in them make up the next level.
+  while (count > 0) {
+    run_level(&pool, level, count);
+
+    vmake_module **next = malloc(sizeof(vmake_module *) * VMAKE_MODULES_INITIAL_SIZE);
+    int next_count = 0;
+    int next_capacity = VMAKE_MODULES_INITIAL_SIZE;
+    for (int i = 0; i < count; i++) {
+      vmake_module *module = level[i];
+      // Files that can't be opened are reported if they're ever included.
+      if (module->source == NULL)
+        continue;
+      module->source->next = state->sources;
+      state->sources = module->source;
+      // Everything that touches the state, like loading from the cache, happens on this thread.
+      vmake_module_load(state, module);
+      find_includes(state, module, &next, &next_count, &next_capacity);
+    }
+
+    free(level);
+    level = next;
+    count = next_count;
+  }
+  free(level);
+#ifdef VMAKE_PARALLEL_INCLUDES
+  if (pool.workers != NULL)
+    stop_workers(&pool);
+#endif
+}
+
+static void run_level(prepare_pool *pool, vmake_module **modules, int count) {
+  pool->modules = modules;
+  pool->count = count;
+#ifdef VMAKE_PARALLEL_INCLUDES
+  if (count > 1 && pool->workers == NULL)
+    start_workers(pool);
+  if (count > 1 && pool->worker_count > 0) {
+    atomic_store(&pool->next, 0);
+    pthread_mutex_lock(&pool->lock);
+    pool->level++;
+    pool->busy = pool->worker_count;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    // This thread works too, and then waits for the modules the workers are still preparing.
+    prepare_modules(pool);
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+      pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+#endif
+
+  for (int i = 0; i < count; i++) {
+    prepare_module(pool->state, modules[i]);
+  }
+}
+
+#ifdef VMAKE_PARALLEL_INCLUDES
+static void start_workers(prepare_pool *pool) {
+  vmake_scanner_setup();
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->ready, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->level = 0;
+  pool->busy = 0;
+  pool->stopping = false;
+
+  long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+  int worker_count = cpu_count > 1 ? cpu_count - 1 : 0;
+  pool->workers = malloc(sizeof(pthread_t) * (worker_count > 0 ? worker_count : 1));
+  // Levels are still prepared on this thread if no worker could be started.
+  while (pool->worker_count < worker_count &&
+         pthread_create(&pool->workers[pool->worker_count], NULL, prepare_worker, pool) == 0)
+    pool->worker_count++;
+}
+
+static void stop_workers(prepare_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->ready);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->worker_count; i++) {
+    pthread_join(pool->workers[i], NULL);
+  }
+  free(pool->workers);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->ready);
+  pthread_cond_destroy(&pool->done);
+}
+
+static void prepare_modules(prepare_pool *pool) {
+  for (int i = atomic_fetch_add(&pool->next, 1); i < pool->count;
+       i = atomic_fetch_add(&pool->next, 1)) {
+    prepare_module(pool->state, pool->modules[i]);
+  }
+}
+
+static void *prepare_worker(void *arg) {
+  prepare_pool *pool = arg;
+  int level = 0;
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (pool->level == level && !pool->stopping) {
+      pthread_cond_wait(&pool->ready, &pool->lock);
+    }
+    if (pool->stopping)
+      break;
+    level = pool->level;
+    pthread_mutex_unlock(&pool->lock);
+
+    prepare_modules(pool);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy == 0)
+      pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+#endif
+
+// Runs on worker threads, so this must not touch anything but the module.
+static void prepare_module(vmake_state *state, vmake_module *module) {
+  module->source = vmake_source_open(module->path);
+  if (module->source == NULL)
+    return;
+  // The hash is kept for loading from and storing to the cache, so it's only computed here.
+  module->hash = vmake_hash_bytes(module->source->chars, module->source->length);
+  // Files in the cache don't need to be scanned, but loading them interns strings, so they're
+  // loaded later on the main thread.
+  if (vmake_cache_contains(state, module->hash))
+    return;
+  vmake_token_buffer_scan(&module->tokens, module->source->chars, module->source->length);
+  module->scanned = true;
+}
+
+static void find_includes(vmake_state *state, vmake_module *module, vmake_module ***found,
+                          int *count, int *capacity) {
+  vmake_token_buffer *tokens = &module->tokens;
+  for (int i = 0; i + 2 < tokens->count; i++) {
+    if ((tokens->types[i] != TOKEN_INCLUDE && tokens->types[i] != TOKEN_INCLUDE_ONCE) ||
+        tokens->types[i + 1] != TOKEN_STRING || tokens->types[i + 2] != TOKEN_SEMICOLON)
+      continue;
+
+    // Resolve the include path the same way the VM does, and remember the result for it.
+    vmake_token token = vmake_token_buffer_get(tokens, i + 1);
+    vmake_value key = vmake_value_obj((vmake_obj *)vmake_obj_string_borrow(
+        state, token.name, token.name_length, token.value.hash));
+    if (vmake_table_has(&module->includes, key))
+      continue;
+    char *include_path = strndup(token.name, token.name_length);
+    char *resolved_path = vmake_path_rel(module->path, include_path);
+    vmake_module *included =
+        resolved_path ? vmake_module_get(&state->modules, resolved_path) : NULL;
+    free(resolved_path);
+    free(include_path);
+    if (included == NULL)
+      continue;
+    vmake_table_put_cpy(&module->includes, key, vmake_value_number(included->index));
+
+    if (included->prepared)
+      continue;
+    included->prepared = true;
+    if (*count == *capacity) {
+      *capacity *= VMAKE_MODULES_GROW_FACTOR;
+      *found = reallocarray(*found, *capacity, sizeof(vmake_module *));
+    }
+    (*found)[(*count)++] = included;
+  }
+}
+
+static uint64_t hash_file(dev_t dev, ino_t ino) {
+  uint64_t key[2] = {dev, ino};
+  return vmake_hash_bytes((const char *)key, sizeof(key));
+}
+
+static int *find_bucket(vmake_module_table *table, dev_t dev, ino_t ino) {
+  int mask = table->capacity * 2 - 1;
+  for (int i = hash_file(dev, ino) & mask;; i = (i + 1) & mask) {
+    int *bucket = table->buckets + i;
+    if (*bucket == -1)
+      return bucket;
+    vmake_module *module = table->modules[*bucket];
+    if (module->dev == dev && module->ino == ino)
+      return bucket;
+  }
+}
+
+static void grow_table(vmake_module_table *table) {
+  table->capacity = table->capacity == 0 ? VMAKE_MODULES_INITIAL_SIZE
+                                         : table->capacity * VMAKE_MODULES_GROW_FACTOR;
+  table->modules = reallocarray(table->modules, table->capacity, sizeof(vmake_module *));
+
+  free(table->buckets);
+  table->buckets = malloc(sizeof(int) * table->capacity * 2);
+  memset(table->buckets, -1, sizeof(int) * table->capacity * 2);
+  for (int i = 0; i < table->count; i++) {
+    *find_bucket(table, table->modules[i]->dev, table->modules[i]->ino) = i;
+  }
+}
@@ -1,37 +1,52 @@
 #include "native/class.h"
 #include "common.h"
 
-static vmake_value *get_field_or_nil(vmake_gen *gen, vmake_obj_instance *inst, const char *name);
-
-static void define_Executable_native(vmake_state *state);
 static vmake_value Executable_get_sources(vmake_obj_instance *self, vmake_gen *gen,
                                           vmake_arguments *args);
 
-void vmake_define_native_classes(vmake_state *state) { define_Executable_native(state); }
+typedef struct native_method_def {
+  const char *name;
+  vmake_native_method method;
+  const vmake_param *params;
+  int param_count;
+} native_method_def;
+
+typedef struct native_class_def {
+  const char *name;
+  vmake_class_type type;
+  const native_method_def *methods;
+  int method_count;
+} native_class_def;
+
+static const native_method_def Executable_methods[] = {
+    // Example method
+    {"get_sources", Executable_get_sources, NULL, 0},
+};
+
+static const native_class_def native_classes[] = {
+    {"Executable", CLASS_EXECUTABLE, Executable_methods, VMAKE_ARRAY_COUNT(Executable_methods)},
+};
+
+void vmake_define_native_classes(vmake_state *state) {
+  for (int i = 0; i < VMAKE_ARRAY_COUNT(native_classes); i++) {
+    const native_class_def *def = native_classes + i;
+    vmake_obj_class *klass = vmake_obj_class_new(state, def->name);
+    for (int j = 0; j < def->method_count; j++) {
+      const native_method_def *method = def->methods + j;
+      vmake_obj_class_add_method(klass, state, method->name, method->method, method->params,
+                                 method->param_count);
+    }
+    vmake_define_native_class(state, klass);
+    state->classes[def->type] = klass;
+  }
+}
 
 void vmake_define_native_class(vmake_state *state, vmake_obj_class *klass) {
-  vmake_table_put_cpy(&state->globals, vmake_value_obj((vmake_obj *)klass->name),
+  vmake_define_global(state, vmake_value_obj((vmake_obj *)klass->name),
                       vmake_value_obj((vmake_obj *)klass));
 }
 
-static vmake_value *get_field_or_nil(vmake_gen *gen, vmake_obj_instance *inst, const char *name) {
-  vmake_value key = vmake_value_obj((vmake_obj *)vmake_obj_string_const(gen->state, name));
-  vmake_value *value = NULL;
-  vmake_table_get_or_nil(&inst->fields, key, &value);
-  return value;
-}
-
-static void define_Executable_native(vmake_state *state) {
-  vmake_obj_class *klass = vmake_obj_class_new(state, "Executable");
-
-  // Example method
-  vmake_obj_class_add_method(klass, state, "get_sources", Executable_get_sources, 0);
-
-  vmake_define_native_class(state, klass);
-  state->classes[CLASS_EXECUTABLE] = klass;
-}
-
 static vmake_value Executable_get_sources(vmake_obj_instance *self, vmake_gen *gen,
                                           vmake_arguments *args) {
-  return *get_field_or_nil(gen, self, "sources");
+  return vmake_obj_instance_get_field(self, gen->state, ATOM_SOURCES);
 }
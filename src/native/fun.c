@@ -3,78 +3,79 @@
 #include "file.h"
 #include "object.h"
 #include "table.h"
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
-static vmake_value expect_val(vmake_gen *gen, vmake_value val, vmake_value_type type);
-static vmake_value expect_obj(vmake_gen *gen, const char *name, vmake_value val,
-                              vmake_obj_type type);
 static void make_paths_absolute(vmake_gen *gen, vmake_obj_array *paths);
+static void put_stat(vmake_gen *gen, vmake_table *table, const char *name, double value);
 
-#define error(gen, fmt, ...) vmake_error_exit(gen, CTX_NATIVE, NULL, fmt, __VA_ARGS__)
-#define EXPECT_STR(name, val) ((vmake_obj_string *)expect_obj(gen, name, val, OBJ_STRING).as.obj)
-#define EXPECT_ARR(name, val) ((vmake_obj_array *)expect_obj(gen, name, val, OBJ_ARRAY).as.obj)
-#define EXPECT_ARR_OPT(name, val)                                                                  \
-  (val.type == VAL_NIL ? vmake_value_nil() : expect_obj(gen, name, val, OBJ_ARRAY))
-#define EXPECT_INST(name, val)                                                                     \
-  ((vmake_obj_instance *)expect_obj(gen, name, val, OBJ_INSTANCE).as.obj)
+static const vmake_param executable_params[] = {
+    {ATOM_NAME, PARAM_STRING, false, false},
+    {ATOM_SOURCES, PARAM_ARRAY, false, false},
+    {ATOM_INCLUDE_DIRECTORIES, PARAM_ARRAY, true, true},
+    {ATOM_LINK_LIBRARIES, PARAM_ARRAY, true, true},
+};
+enum { EXECUTABLE_NAME, EXECUTABLE_SOURCES, EXECUTABLE_INCLUDE_DIRS, EXECUTABLE_LINK_LIBS };
 
-static vmake_value expect_val(vmake_gen *gen, vmake_value val, vmake_value_type type) {
-  if (val.type == type)
-    return val;
-  error(gen, "Expected %s but found %s instead.", vmake_value_type_to_string(type),
-        vmake_value_type_to_string(val.type));
-  return val;
-}
+static const vmake_param get_properties_params[] = {
+    {ATOM_INSTANCE, PARAM_INSTANCE, false, false},
+};
 
-static vmake_value expect_obj(vmake_gen *gen, const char *name, vmake_value val,
-                              vmake_obj_type type) {
-  if (val.type == VAL_OBJ && val.as.obj->type == type)
-    return val;
-  error(gen, "Expected %s for '%s' but found %s instead.", vmake_obj_type_to_string(type), name,
-        val.type == VAL_OBJ ? vmake_obj_type_to_string(val.as.obj->type)
-                            : vmake_value_type_to_string(val.type));
-  return vmake_value_nil();
-}
+typedef struct native_function_def {
+  const char *name;
+  vmake_native_function function;
+  const vmake_param *params;
+  int param_count;
+} native_function_def;
+
+static const native_function_def native_functions[] = {
+    {"executable", vmake_executable_native, executable_params,
+     VMAKE_ARRAY_COUNT(executable_params)},
+    {"get_properties", vmake_get_properties_native, get_properties_params,
+     VMAKE_ARRAY_COUNT(get_properties_params)},
+    {"heap_stats", vmake_heap_stats_native, NULL, 0},
+};
 
 void vmake_define_native_functions(vmake_state *state) {
-  vmake_define_native_function(state, "executable", vmake_executable_native, 1);
-  vmake_define_native_function(state, "get_properties", vmake_get_properties_native, 1);
+  for (int i = 0; i < VMAKE_ARRAY_COUNT(native_functions); i++) {
+    const native_function_def *def = native_functions + i;
+    vmake_define_native_function(state, def->name, def->function, def->params, def->param_count);
+  }
 }
 
 void vmake_define_native_function(vmake_state *state, const char *name, vmake_native_function fn,
-                                  int argc) {
-  vmake_obj_native *native = vmake_obj_native_new(state, name, fn, argc);
-  vmake_table_put_cpy(&state->globals, vmake_value_obj((vmake_obj *)native->name),
+                                  const vmake_param *params, int param_count) {
+  vmake_obj_native *native = vmake_obj_native_new(state, name, fn, params, param_count);
+  vmake_define_global(state, vmake_value_obj((vmake_obj *)native->name),
                       vmake_value_obj((vmake_obj *)native));
 }
 
-vmake_value vmake_kwargs_get(vmake_gen *gen, vmake_table kwargs, const char *value) {
-  vmake_value *val = NULL;
-  vmake_table_get_or_nil(
-      &kwargs, vmake_value_obj((vmake_obj *)vmake_obj_string_const(gen->state, value)), &val);
-  return *val;
-}
-
 vmake_value vmake_executable_native(vmake_gen *gen, vmake_arguments *args) {
-  vmake_obj_string *exe_name = EXPECT_STR("name", args->args.values[0]);
-  vmake_obj_array *sources = EXPECT_ARR("sources", vmake_kwargs_get(gen, args->kwargs, "sources"));
-  vmake_value include_directories = EXPECT_ARR_OPT(
-      "include_directories", vmake_kwargs_get(gen, args->kwargs, "include_directories"));
-  vmake_value link_libraries =
-      EXPECT_ARR_OPT("link_libraries", vmake_kwargs_get(gen, args->kwargs, "link_libraries"));
+  vmake_obj_string *exe_name =
+      (vmake_obj_string *)vmake_value_as_obj(args->slots[EXECUTABLE_NAME]);
+  // The target gets its own copies of the lists it's passed, so that making their paths absolute
+  // doesn't change the caller's arrays. The copies share the caller's elements until then.
+  vmake_obj_array *sources = vmake_obj_array_copy(
+      gen->state, (vmake_obj_array *)vmake_value_as_obj(args->slots[EXECUTABLE_SOURCES]));
+  vmake_value include_directories = args->slots[EXECUTABLE_INCLUDE_DIRS];
+  vmake_value link_libraries = args->slots[EXECUTABLE_LINK_LIBS];
 
   make_paths_absolute(gen, sources);
-  if (include_directories.type != VAL_NIL) {
-    make_paths_absolute(gen, (vmake_obj_array *)include_directories.as.obj);
+  if (!vmake_value_is_nil(include_directories)) {
+    vmake_obj_array *dirs = vmake_obj_array_copy(
+        gen->state, (vmake_obj_array *)vmake_value_as_obj(include_directories));
+    make_paths_absolute(gen, dirs);
+    include_directories = vmake_value_obj((vmake_obj *)dirs);
   }
 
   vmake_obj_instance *inst =
       vmake_obj_instance_new(gen->state, gen->state->classes[CLASS_EXECUTABLE]);
-  vmake_obj_instance_add_field(inst, gen->state, "name", vmake_value_obj((vmake_obj *)exe_name));
-  vmake_obj_instance_add_field(inst, gen->state, "sources", vmake_value_obj((vmake_obj *)sources));
-  vmake_obj_instance_add_field(inst, gen->state, "include_directories", include_directories);
-  vmake_obj_instance_add_field(inst, gen->state, "link_libraries", link_libraries);
+  vmake_obj_instance_add_field(inst, gen->state, ATOM_NAME, vmake_value_obj((vmake_obj *)exe_name));
+  vmake_obj_instance_add_field(inst, gen->state, ATOM_SOURCES,
+                               vmake_value_obj((vmake_obj *)sources));
+  vmake_obj_instance_add_field(inst, gen->state, ATOM_INCLUDE_DIRECTORIES, include_directories);
+  vmake_obj_instance_add_field(inst, gen->state, ATOM_LINK_LIBRARIES, link_libraries);
 
   vmake_value val = vmake_value_obj((vmake_obj *)inst);
   vmake_value_array_push(&gen->state->make.targets, val);
@@ -82,20 +83,57 @@ vmake_value vmake_executable_native(vmake_gen *gen, vmake_arguments *args) {
 }
 
 vmake_value vmake_get_properties_native(vmake_gen *gen, vmake_arguments *args) {
-  vmake_obj_instance *inst = EXPECT_INST("instance", args->args.values[0]);
-  return vmake_value_obj((vmake_obj *)vmake_obj_table_new(gen->state, inst->fields));
+  vmake_obj_instance *inst = (vmake_obj_instance *)vmake_value_as_obj(args->slots[0]);
+  vmake_obj_table *properties = vmake_obj_instance_properties(inst, gen->state);
+  vmake_obj_table *copy = vmake_obj_table_copy(gen->state, properties);
+  // Arrays are shared by reference, so the table gets its own copies of the fields' arrays, or
+  // changing them through one would change the other. The copies share their elements until then.
+  vmake_table *entries = vmake_obj_table_mut(gen->state, copy);
+  for (int i = 0; i < entries->entry_count; i++) {
+    vmake_table_entry *entry = vmake_table_entry_at(entries, i);
+    if (!vmake_value_is_empty(entry->key) && vmake_value_is_array(entry->value)) {
+      vmake_obj_array *arr = (vmake_obj_array *)vmake_value_as_obj(entry->value);
+      entry->value = vmake_value_obj((vmake_obj *)vmake_obj_array_copy(gen->state, arr));
+    }
+  }
+  return vmake_value_obj((vmake_obj *)copy);
+}
+
+vmake_value vmake_heap_stats_native(vmake_gen *gen, vmake_arguments *args) {
+  vmake_state *state = gen->state;
+  vmake_table stats;
+  vmake_table_init(&stats);
+  put_stat(gen, &stats, "allocated", state->arena.allocated);
+  put_stat(gen, &stats, "threshold", state->gc.stats.threshold);
+  put_stat(gen, &stats, "collections", state->gc.stats.collections);
+  put_stat(gen, &stats, "freed_bytes", state->gc.stats.freed_bytes);
+  put_stat(gen, &stats, "freed_objects", state->gc.stats.freed_objects);
+  put_stat(gen, &stats, "literal_bytes", state->strings.page_bytes);
+  return vmake_value_obj((vmake_obj *)vmake_obj_table_new(state, stats));
+}
+
+static void put_stat(vmake_gen *gen, vmake_table *table, const char *name, double value) {
+  vmake_value key = vmake_value_obj((vmake_obj *)vmake_obj_string_const(gen->state, name));
+  vmake_table_put_cpy(table, key, vmake_value_number(value));
 }
 
+// Only writes the paths that aren't already absolute, so that lists of absolute paths, such as the
+// sources of another target, keep sharing their elements.
 static void make_paths_absolute(vmake_gen *gen, vmake_obj_array *paths) {
-  for (int i = 0; i < paths->array->size; i++) {
-    char *file_name = ((vmake_obj_string *)paths->array->values[i].as.obj)->chars;
+  for (int i = 0; i < vmake_obj_array_values(paths)->size; i++) {
+    vmake_value path = vmake_obj_array_values(paths)->values[i];
+    vmake_obj_string *file_str = (vmake_obj_string *)vmake_value_as_obj(path);
+    char *file_name = strndup(file_str->chars, file_str->length);
     char *path_rel = vmake_path_rel(gen->file_path, file_name);
-    char *path_abs = realpath(path_rel, NULL);
-    if (!path_abs) {
+    char path_abs[PATH_MAX];
+    if (!realpath(path_rel, path_abs)) {
       vmake_error_exit(gen, CTX_INTERNAL, NULL, "Could not find file at '%s'", file_name);
     }
     free(path_rel);
-    paths->array->values[i].as.obj =
-        (vmake_obj *)vmake_obj_string_new(gen->state, path_abs, strlen(path_abs), false);
+    free(file_name);
+    vmake_obj_string *abs_str =
+        vmake_obj_string_new(gen->state, path_abs, strlen(path_abs), true);
+    if (abs_str != file_str)
+      vmake_obj_array_mut(gen->state, paths)->values[i] = vmake_value_obj((vmake_obj *)abs_str);
   }
 }
@@ -1,6 +1,7 @@
 #include "object.h"
 #include "common.h"
 #include "generator.h"
+#include "hash.h"
 #include "table.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,6 +9,15 @@
 
 #define OBJ_NEW(struct_t, type) (struct_t *)vmake_obj_new(state, sizeof(struct_t), type)
 
+static vmake_obj_string *allocate_string(vmake_state *state, int length, uint32_t hash);
+static vmake_obj_string *intern(vmake_state *state, vmake_obj_string *obj);
+static void detach_chars(vmake_state *state, vmake_obj_string *obj);
+static int text_length(vmake_obj *obj);
+static vmake_array_storage *new_array_storage(vmake_state *state, vmake_value_array array);
+static void release_array_storage(vmake_state *state, vmake_array_storage *storage);
+static vmake_table_storage *new_table_storage(vmake_state *state, vmake_table table);
+static void release_table_storage(vmake_state *state, vmake_table_storage *storage);
+
 char *vmake_obj_type_to_string(vmake_obj_type type) {
   switch (type) {
   case OBJ_STRING:
@@ -24,22 +34,48 @@ char *vmake_obj_type_to_string(vmake_obj_type type) {
     return "method";
   case OBJ_TABLE:
     return "table";
+  case OBJ_ROPE:
+    return "string";
+  case OBJ_SHAPE:
+    return "shape";
   }
 
   return "obj unknown";
 }
 
-vmake_obj *vmake_obj_new(vmake_state *state, size_t size, vmake_obj_type type) {
-  vmake_obj *obj = malloc(size);
-  obj->type = type;
+char *vmake_param_type_to_string(vmake_param_type type) {
+  switch (type) {
+  case PARAM_ANY:
+    return "any";
+  case PARAM_STRING:
+    return "string";
+  case PARAM_ARRAY:
+    return "array";
+  case PARAM_INSTANCE:
+    return "instance";
+  }
+
+  return "param unknown";
+}
 
-  if (state->objects == NULL)
-    state->objects = obj;
-  else {
-    obj->next = state->objects;
-    state->objects = obj;
+void vmake_signature_init(vmake_signature *sig, vmake_state *state, const vmake_param *params,
+                          int count) {
+  sig->params = params;
+  sig->count = count;
+  sig->positional = 0;
+  for (int i = 0; i < count; i++) {
+    sig->names[i] = state->atoms[params[i].name];
+    if (!params[i].keyword_only)
+      sig->positional = i + 1;
   }
+}
 
+vmake_obj *vmake_obj_new(vmake_state *state, size_t size, vmake_obj_type type) {
+  vmake_obj *obj = vmake_arena_alloc(&state->arena, size);
+  obj->type = type;
+  obj->marked = false;
+  obj->next = state->objects;
+  state->objects = obj;
   return obj;
 }
 
@@ -52,14 +88,24 @@ char *vmake_obj_to_string(vmake_obj *obj) {
     vmake_string_buf_append(&buf, "\"%.*s\"", str->length, str->chars);
     return buf.string;
   }
+  case OBJ_ROPE: {
+    vmake_obj_rope *rope = (vmake_obj_rope *)obj;
+    char *buf = malloc(rope->length + 3);
+    buf[0] = '"';
+    vmake_obj_rope_write(rope, buf + 1);
+    buf[rope->length + 1] = '"';
+    buf[rope->length + 2] = '\0';
+    return buf;
+  }
   case OBJ_NATIVE: {
+    char *name = vmake_obj_to_string((vmake_obj *)((vmake_obj_native *)obj)->name);
     char *buf;
-    asprintf(&buf, "<native %s>",
-             vmake_obj_to_string((vmake_obj *)((vmake_obj_native *)obj)->name));
+    asprintf(&buf, "<native %s>", name);
+    free(name);
     return buf;
   }
   case OBJ_ARRAY: {
-    vmake_value_array *arr = ((vmake_obj_array *)obj)->array;
+    const vmake_value_array *arr = vmake_obj_array_values((vmake_obj_array *)obj);
     vmake_string_buf buf;
     vmake_string_buf_new(&buf);
     vmake_string_buf_append(&buf, "[");
@@ -96,17 +142,22 @@ char *vmake_obj_to_string(vmake_obj *obj) {
     free(method_name);
     return buf;
   }
+  case OBJ_SHAPE: {
+    char *buf;
+    asprintf(&buf, "<shape %i>", ((vmake_obj_shape *)obj)->field_count);
+    return buf;
+  }
   case OBJ_TABLE: {
-    vmake_table *table = ((vmake_obj_table *)obj)->table;
+    vmake_table *table = vmake_obj_table_entries((vmake_obj_table *)obj);
     vmake_string_buf buf;
     vmake_string_buf_new(&buf);
     vmake_string_buf_append(&buf, "{");
     bool first = true;
-    for (int i = 0; i < table->capacity; i++) {
-      vmake_table_entry entry = table->entries[i];
-      if (entry.key.type != VAL_EMPTY) {
-        char *key = vmake_value_to_string(entry.key);
-        char *value = vmake_value_to_string(*entry.value);
+    for (int i = 0; i < table->entry_count; i++) {
+      vmake_table_entry *entry = vmake_table_entry_at(table, i);
+      if (!vmake_value_is_empty(entry->key)) {
+        char *key = vmake_value_to_string(entry->key);
+        char *value = vmake_value_to_string(entry->value);
         if (!first)
           vmake_string_buf_append(&buf, ", ");
         vmake_string_buf_append(&buf, "%s=%s", key, value);
@@ -133,149 +184,448 @@ void vmake_obj_print(vmake_obj *obj) {
   free(buf);
 }
 
-void vmake_obj_free(vmake_obj *obj) { free(obj); }
+void vmake_obj_free(vmake_state *state, vmake_obj *obj) {
+  switch (obj->type) {
+  case OBJ_STRING:
+    vmake_obj_string_free(state, (vmake_obj_string *)obj);
+    break;
+  case OBJ_ROPE:
+    vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_rope));
+    break;
+  case OBJ_NATIVE:
+    vmake_obj_native_free(state, (vmake_obj_native *)obj);
+    break;
+  case OBJ_ARRAY:
+    vmake_obj_array_free(state, (vmake_obj_array *)obj);
+    break;
+  case OBJ_CLASS:
+    vmake_obj_class_free(state, (vmake_obj_class *)obj);
+    break;
+  case OBJ_INSTANCE:
+    vmake_obj_instance_free(state, (vmake_obj_instance *)obj);
+    break;
+  case OBJ_METHOD:
+    vmake_obj_method_free(state, (vmake_obj_method *)obj);
+    break;
+  case OBJ_TABLE:
+    vmake_obj_table_free(state, (vmake_obj_table *)obj);
+    break;
+  case OBJ_SHAPE:
+    vmake_obj_shape_free(state, (vmake_obj_shape *)obj);
+    break;
+  }
+}
+
+void vmake_objects_free(vmake_state *state) {
+  // Objects live in the arena, so only what they own outside of it has to be freed one by one.
+  for (vmake_obj *obj = state->objects; obj != NULL; obj = obj->next) {
+    switch (obj->type) {
+    case OBJ_ARRAY:
+      release_array_storage(state, ((vmake_obj_array *)obj)->storage);
+      break;
+    case OBJ_CLASS:
+      vmake_table_free(&((vmake_obj_class *)obj)->methods);
+      break;
+    case OBJ_TABLE:
+      release_table_storage(state, ((vmake_obj_table *)obj)->storage);
+      break;
+    default:
+      break;
+    }
+  }
+  state->objects = NULL;
+  vmake_arena_free(&state->arena);
+}
 
 vmake_obj_string *vmake_obj_string_const(vmake_state *state, const char *str) {
   return vmake_obj_string_new(state, (char *)str, strlen(str), true);
 }
 
 vmake_obj_string *vmake_obj_string_new(vmake_state *state, char *chars, int length, bool copy) {
-  // Implementation of the FNV-1a algorithm. Constant values are taken from
-  // http://www.isthe.com/chongo/tech/comp/fnv/#FNV-param
-  uint32_t hash = 2166136261;
-  for (int i = 0; i < length; i++) {
-    hash = hash ^ chars[i];
-    hash = hash * 16777619;
-  }
+  uint32_t hash = vmake_hash_chars(chars, length);
 
   // If the string is interned, no point in allocating new memory.
-  vmake_obj_string *interned = vmake_table_find_string(&state->strings, chars, length, hash);
-  if (interned != NULL) {
-    // We only free the passed characters if the string is interned and we own
-    // the characters, that is if we aren't copying the string, and the string
-    // is not constant.
-    if (!copy) {
-      free(chars);
-    }
-    return interned;
+  vmake_obj_string *interned = vmake_interner_find(&state->strings, chars, length, hash);
+  if (interned == NULL) {
+    interned = allocate_string(state, length, hash);
+    memcpy(interned->bytes, chars, length);
+    intern(state, interned);
+  } else if (interned->borrowed) {
+    detach_chars(state, interned);
   }
 
-  vmake_obj_string *obj = OBJ_NEW(vmake_obj_string, OBJ_STRING);
-  if (copy) {
-    obj->chars = malloc(length + 1);
-    memcpy(obj->chars, chars, length);
-    obj->chars[length] = '\0';
-  } else {
-    obj->chars = chars;
+  // We only free the passed characters if we own them, that is if we aren't copying the string.
+  // Either way, the string ends up with its own copy.
+  if (!copy)
+    free(chars);
+  return interned;
+}
+
+vmake_obj_string *vmake_obj_string_borrow(vmake_state *state, const char *chars, int length,
+                                          uint32_t hash) {
+  vmake_obj_string *interned = vmake_interner_find(&state->strings, chars, length, hash);
+  if (interned != NULL)
+    return interned;
+
+  // Short strings are cheaper to copy than to borrow, since their characters then sit next to their
+  // header and never need to be detached.
+  if (length <= VMAKE_STRING_SHORT_MAX) {
+    vmake_obj_string *obj = allocate_string(state, length, hash);
+    memcpy(obj->bytes, chars, length);
+    return intern(state, obj);
   }
+
+  vmake_obj_string *obj =
+      (vmake_obj_string *)vmake_obj_new(state, sizeof(vmake_obj_string), OBJ_STRING);
+  obj->length = length;
+  obj->hash = hash;
+  obj->chars = (char *)chars;
+  obj->borrowed = true;
+  return intern(state, obj);
+}
+
+void vmake_obj_string_free(vmake_state *state, vmake_obj_string *obj) {
+  // Characters that aren't stored with the string belong to a source, or to the interner if the
+  // string was detached from its source.
+  if (obj->chars == obj->bytes)
+    vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_string) + obj->length + 1);
+  else
+    vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_string));
+}
+
+// Allocates a string with room for `length` characters after its header, which the caller fills in
+// before interning it.
+static vmake_obj_string *allocate_string(vmake_state *state, int length, uint32_t hash) {
+  vmake_obj_string *obj =
+      (vmake_obj_string *)vmake_obj_new(state, sizeof(vmake_obj_string) + length + 1, OBJ_STRING);
   obj->length = length;
   obj->hash = hash;
+  obj->chars = obj->bytes;
+  obj->chars[length] = '\0';
+  obj->borrowed = false;
+  return obj;
+}
 
-  // Intern the newly-created string
-  vmake_table_put_ptr(&state->strings, vmake_value_obj((vmake_obj *)obj), NULL);
+static vmake_obj_string *intern(vmake_state *state, vmake_obj_string *obj) {
+  vmake_interner_add(&state->strings, obj);
+  return obj;
+}
 
+// Callers of vmake_obj_string_new expect NUL-terminated characters, which a borrowed string doesn't
+// have. Interned strings are compared by identity, so instead of creating a new string, the
+// interned one gets its own copy of its characters. Borrowed strings are literals of sources, which
+// live as long as the state, so the copy goes to the interner's pages instead of the arena.
+static void detach_chars(vmake_state *state, vmake_obj_string *obj) {
+  obj->chars = vmake_interner_copy_chars(&state->strings, obj->chars, obj->length);
+  obj->borrowed = false;
+}
+
+vmake_obj_rope *vmake_obj_rope_new(vmake_state *state, vmake_obj *left, vmake_obj *right) {
+  vmake_obj_rope *obj = OBJ_NEW(vmake_obj_rope, OBJ_ROPE);
+  obj->left = left;
+  obj->right = right;
+  obj->length = text_length(left) + text_length(right);
+  obj->flat = NULL;
   return obj;
 }
 
-void vmake_obj_string_free(vmake_obj_string *obj) {
-  free(obj->chars);
-  free(obj);
+void vmake_obj_rope_write(vmake_obj_rope *rope, char *dst) {
+  // Chains like `a + b + c` build ropes that are deep on the left, so we walk down the left side in
+  // a loop, writing right children from the end, and only recurse into right children.
+  char *end = dst + rope->length;
+  vmake_obj *node = (vmake_obj *)rope;
+  while (node->type == OBJ_ROPE && ((vmake_obj_rope *)node)->flat == NULL) {
+    vmake_obj_rope *current = (vmake_obj_rope *)node;
+    end -= text_length(current->right);
+    if (current->right->type == OBJ_ROPE)
+      vmake_obj_rope_write((vmake_obj_rope *)current->right, end);
+    else
+      memcpy(end, ((vmake_obj_string *)current->right)->chars, text_length(current->right));
+    node = current->left;
+  }
+
+  vmake_obj_string *str = node->type == OBJ_ROPE ? ((vmake_obj_rope *)node)->flat
+                                                 : (vmake_obj_string *)node;
+  memcpy(dst, str->chars, str->length);
+}
+
+vmake_obj_string *vmake_obj_rope_flatten(vmake_state *state, vmake_obj_rope *rope) {
+  if (rope->flat == NULL) {
+    // The characters are written straight into a new string, which is only kept if the result
+    // isn't interned yet.
+    vmake_obj_string *str = allocate_string(state, rope->length, 0);
+    vmake_obj_rope_write(rope, str->bytes);
+    str->hash = vmake_hash_chars(str->bytes, str->length);
+    vmake_obj_string *interned =
+        vmake_interner_find(&state->strings, str->bytes, str->length, str->hash);
+    if (interned == NULL) {
+      rope->flat = intern(state, str);
+    } else {
+      // Nothing was allocated since the string, so it's still at the head of the object list.
+      state->objects = str->obj.next;
+      vmake_obj_string_free(state, str);
+      if (interned->borrowed)
+        detach_chars(state, interned);
+      rope->flat = interned;
+    }
+  }
+  return rope->flat;
+}
+
+static int text_length(vmake_obj *obj) {
+  if (obj->type == OBJ_ROPE)
+    return ((vmake_obj_rope *)obj)->length;
+  return ((vmake_obj_string *)obj)->length;
 }
 
 vmake_obj_native *vmake_obj_native_new(vmake_state *state, const char *name,
-                                       vmake_native_function function, int arity) {
+                                       vmake_native_function function, const vmake_param *params,
+                                       int param_count) {
   vmake_obj_native *obj = OBJ_NEW(vmake_obj_native, OBJ_NATIVE);
-  obj->arity = arity;
+  vmake_signature_init(&obj->signature, state, params, param_count);
   obj->name = vmake_obj_string_new(state, (char *)name, strlen(name), true);
   obj->function = function;
   return obj;
 }
 
-void vmake_obj_native_free(vmake_obj_native *obj) {
-  vmake_obj_string_free(obj->name);
-  free(obj);
+void vmake_obj_native_free(vmake_state *state, vmake_obj_native *obj) {
+  vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_native));
 }
 
 vmake_obj_array *vmake_obj_array_new(vmake_state *state, vmake_value_array array) {
   vmake_obj_array *obj = OBJ_NEW(vmake_obj_array, OBJ_ARRAY);
-  obj->array = malloc(sizeof(vmake_value_array));
-  *obj->array = array;
+  obj->storage = new_array_storage(state, array);
   return obj;
 }
 
-void vmake_obj_array_free(vmake_obj_array *obj) {
-  free(obj->array);
-  free(obj);
+vmake_obj_array *vmake_obj_array_copy(vmake_state *state, vmake_obj_array *obj) {
+  vmake_obj_array *copy = OBJ_NEW(vmake_obj_array, OBJ_ARRAY);
+  copy->storage = obj->storage;
+  copy->storage->refs++;
+  return copy;
+}
+
+vmake_value_array *vmake_obj_array_mut(vmake_state *state, vmake_obj_array *obj) {
+  if (obj->storage->refs > 1) {
+    const vmake_value_array *shared = &obj->storage->array;
+    vmake_value_array array;
+    vmake_value_array_new(&array);
+    vmake_value_array_reserve(&array, shared->size);
+    for (int i = 0; i < shared->size; i++) {
+      array.values[i] = shared->values[i];
+    }
+    array.size = shared->size;
+    obj->storage->refs--;
+    obj->storage = new_array_storage(state, array);
+  }
+  return &obj->storage->array;
+}
+
+void vmake_obj_array_push(vmake_state *state, vmake_obj_array *obj, vmake_value val) {
+  vmake_value_array *array = vmake_obj_array_mut(state, obj);
+  vmake_value_array_push(array, val);
+  size_t bytes = sizeof(vmake_value) * array->capacity;
+  vmake_arena_account(&state->arena, obj->storage->bytes, bytes);
+  obj->storage->bytes = bytes;
+}
+
+void vmake_obj_array_free(vmake_state *state, vmake_obj_array *obj) {
+  release_array_storage(state, obj->storage);
+  vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_array));
+}
+
+vmake_obj_shape *vmake_obj_shape_new(vmake_state *state) {
+  vmake_obj_shape *obj = OBJ_NEW(vmake_obj_shape, OBJ_SHAPE);
+  obj->names = NULL;
+  obj->field_count = 0;
+  obj->children = NULL;
+  obj->next_sibling = NULL;
+  return obj;
+}
+
+int vmake_obj_shape_find(vmake_obj_shape *shape, vmake_obj_string *name) {
+  // Instances only have a handful of fields, and names are interned, so a linear search beats
+  // hashing the name.
+  for (int i = 0; i < shape->field_count; i++) {
+    if (shape->names[i] == name)
+      return i;
+  }
+  return -1;
+}
+
+vmake_obj_shape *vmake_obj_shape_add(vmake_state *state, vmake_obj_shape *shape,
+                                     vmake_obj_string *name) {
+  for (vmake_obj_shape *child = shape->children; child != NULL; child = child->next_sibling) {
+    if (child->names[shape->field_count] == name)
+      return child;
+  }
+
+  vmake_obj_shape *child = vmake_obj_shape_new(state);
+  child->field_count = shape->field_count + 1;
+  child->names =
+      vmake_arena_alloc(&state->arena, sizeof(vmake_obj_string *) * child->field_count);
+  // The names of the empty shape are NULL, which memcpy must not be given even to copy nothing.
+  if (shape->field_count > 0)
+    memcpy(child->names, shape->names, sizeof(vmake_obj_string *) * shape->field_count);
+  child->names[shape->field_count] = name;
+  child->next_sibling = shape->children;
+  shape->children = child;
+  return child;
+}
+
+void vmake_obj_shape_free(vmake_state *state, vmake_obj_shape *obj) {
+  vmake_arena_release(&state->arena, obj->names, sizeof(vmake_obj_string *) * obj->field_count);
+  vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_shape));
 }
 
 vmake_obj_class *vmake_obj_class_new(vmake_state *state, const char *name) {
   vmake_obj_class *obj = OBJ_NEW(vmake_obj_class, OBJ_CLASS);
   obj->name = vmake_obj_string_new(state, (char *)name, strlen(name), true);
   vmake_table_init(&obj->methods);
+  obj->shape = vmake_obj_shape_new(state);
   return obj;
 }
 
 void vmake_obj_class_add_method(vmake_obj_class *obj, vmake_state *state, const char *name,
-                                vmake_native_method method, int arity) {
+                                vmake_native_method method, const vmake_param *params,
+                                int param_count) {
   vmake_value key = vmake_value_obj((vmake_obj *)vmake_obj_string_const(state, name));
-  vmake_value value =
-      vmake_value_obj((vmake_obj *)vmake_obj_method_new(state, name, method, arity));
+  vmake_value value = vmake_value_obj(
+      (vmake_obj *)vmake_obj_method_new(state, name, method, params, param_count));
   vmake_table_put_cpy(&obj->methods, key, value);
 }
 
-void vmake_obj_class_free(vmake_obj_class *obj) {
-  vmake_obj_string_free(obj->name);
-  free(obj);
+void vmake_obj_class_free(vmake_state *state, vmake_obj_class *obj) {
+  vmake_table_free(&obj->methods);
+  vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_class));
 }
 
 vmake_obj_instance *vmake_obj_instance_new(vmake_state *state, vmake_obj_class *klass) {
   vmake_obj_instance *obj = OBJ_NEW(vmake_obj_instance, OBJ_INSTANCE);
   obj->klass = klass;
-  vmake_table_init(&obj->fields);
+  obj->shape = klass->shape;
+  obj->fields = NULL;
+  obj->properties = NULL;
   return obj;
 }
 
-void vmake_obj_instance_add_field(vmake_obj_instance *obj, vmake_state *state, const char *name,
+void vmake_obj_instance_add_field(vmake_obj_instance *obj, vmake_state *state, vmake_atom name,
                                   vmake_value value) {
-  vmake_value key = vmake_value_obj((vmake_obj *)vmake_obj_string_const(state, name));
-  vmake_table_put_cpy(&obj->fields, key, value);
+  vmake_value *field = vmake_obj_instance_find_field(obj, state->atoms[name]);
+  if (field == NULL) {
+    obj->shape = vmake_obj_shape_add(state, obj->shape, state->atoms[name]);
+    obj->fields = vmake_arena_realloc(&state->arena, obj->fields,
+                                      sizeof(vmake_value) * (obj->shape->field_count - 1),
+                                      sizeof(vmake_value) * obj->shape->field_count);
+    field = obj->fields + obj->shape->field_count - 1;
+  }
+  *field = value;
+  obj->properties = NULL;
 }
 
 vmake_value vmake_obj_instance_get_field(vmake_obj_instance *obj, vmake_state *state,
-                                         const char *name) {
-  vmake_value key = vmake_value_obj((vmake_obj *)vmake_obj_string_const(state, name));
-  vmake_value *ret = NULL;
-  vmake_table_get_or_nil(&obj->fields, key, &ret);
-  return *ret;
+                                         vmake_atom name) {
+  vmake_value *field = vmake_obj_instance_find_field(obj, state->atoms[name]);
+  return field == NULL ? vmake_value_nil() : *field;
+}
+
+vmake_value *vmake_obj_instance_find_field(vmake_obj_instance *obj, vmake_obj_string *name) {
+  int slot = vmake_obj_shape_find(obj->shape, name);
+  return slot == -1 ? NULL : obj->fields + slot;
+}
+
+vmake_obj_table *vmake_obj_instance_properties(vmake_obj_instance *obj, vmake_state *state) {
+  if (obj->properties == NULL) {
+    vmake_table table;
+    vmake_table_init(&table);
+    for (int i = 0; i < obj->shape->field_count; i++) {
+      vmake_table_put_cpy(&table, vmake_value_obj((vmake_obj *)obj->shape->names[i]),
+                          obj->fields[i]);
+    }
+    obj->properties = vmake_obj_table_new(state, table);
+  }
+  return obj->properties;
 }
 
-void vmake_obj_instance_free(vmake_obj_instance *obj) {
-  vmake_table_free(&obj->fields);
-  free(obj);
+void vmake_obj_instance_free(vmake_state *state, vmake_obj_instance *obj) {
+  vmake_arena_release(&state->arena, obj->fields, sizeof(vmake_value) * obj->shape->field_count);
+  vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_instance));
 }
 
 vmake_obj_method *vmake_obj_method_new(vmake_state *state, const char *name,
-                                       vmake_native_method method, int arity) {
+                                       vmake_native_method method, const vmake_param *params,
+                                       int param_count) {
   vmake_obj_method *obj = OBJ_NEW(vmake_obj_method, OBJ_METHOD);
   obj->method = method;
   obj->name = vmake_obj_string_new(state, (char *)name, strlen(name), true);
-  obj->arity = arity;
+  vmake_signature_init(&obj->signature, state, params, param_count);
   return obj;
 }
 
-void vmake_obj_method_free(vmake_obj_method *obj) {
-  vmake_obj_string_free(obj->name);
-  free(obj);
+void vmake_obj_method_free(vmake_state *state, vmake_obj_method *obj) {
+  vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_method));
 }
 
 vmake_obj_table *vmake_obj_table_new(vmake_state *state, vmake_table table) {
   vmake_obj_table *obj = OBJ_NEW(vmake_obj_table, OBJ_TABLE);
-  obj->table = malloc(sizeof(table));
-  *obj->table = table;
+  obj->storage = new_table_storage(state, table);
   return obj;
 }
 
-void vmake_obj_table_free(vmake_obj_table *obj) {
-  free(obj->table);
-  free(obj);
+vmake_obj_table *vmake_obj_table_copy(vmake_state *state, vmake_obj_table *obj) {
+  vmake_obj_table *copy = OBJ_NEW(vmake_obj_table, OBJ_TABLE);
+  copy->storage = obj->storage;
+  copy->storage->refs++;
+  return copy;
+}
+
+vmake_table *vmake_obj_table_mut(vmake_state *state, vmake_obj_table *obj) {
+  if (obj->storage->refs > 1) {
+    vmake_table table;
+    vmake_table_init(&table);
+    vmake_table_copy_to(&obj->storage->table, &table);
+    obj->storage->refs--;
+    obj->storage = new_table_storage(state, table);
+  }
+  return &obj->storage->table;
+}
+
+void vmake_obj_table_free(vmake_state *state, vmake_obj_table *obj) {
+  release_table_storage(state, obj->storage);
+  vmake_arena_release(&state->arena, obj, sizeof(vmake_obj_table));
+}
+
+static vmake_array_storage *new_array_storage(vmake_state *state, vmake_value_array array) {
+  vmake_array_storage *storage = vmake_arena_alloc(&state->arena, sizeof(vmake_array_storage));
+  storage->refs = 1;
+  storage->array = array;
+  // The elements are counted towards collections like the objects themselves.
+  storage->bytes = sizeof(vmake_value) * array.capacity;
+  vmake_arena_account(&state->arena, 0, storage->bytes);
+  return storage;
+}
+
+static void release_array_storage(vmake_state *state, vmake_array_storage *storage) {
+  if (--storage->refs > 0)
+    return;
+  vmake_arena_account(&state->arena, storage->bytes, 0);
+  vmake_value_array_free(&storage->array);
+  vmake_arena_release(&state->arena, storage, sizeof(vmake_array_storage));
+}
+
+static vmake_table_storage *new_table_storage(vmake_state *state, vmake_table table) {
+  vmake_table_storage *storage = vmake_arena_alloc(&state->arena, sizeof(vmake_table_storage));
+  storage->refs = 1;
+  storage->table = table;
+  storage->bytes = vmake_table_bytes(&table);
+  vmake_arena_account(&state->arena, 0, storage->bytes);
+  return storage;
+}
+
+static void release_table_storage(vmake_state *state, vmake_table_storage *storage) {
+  if (--storage->refs > 0)
+    return;
+  vmake_arena_account(&state->arena, storage->bytes, 0);
+  vmake_table_free(&storage->table);
+  vmake_arena_release(&state->arena, storage, sizeof(vmake_table_storage));
 }
@@ -0,0 +1,217 @@
+#include "scanner-simd.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VMAKE_SCAN_X86
+#include <immintrin.h>
+#endif
+
+// The SIMD kernels all follow the same pattern: compare a whole block against the characters we're
+// looking for, turn the comparison into a bit mask with movemask, and find the first character
+// that ends the run with a count of trailing zeros. The last partial block is handled by the
+// scalar kernels, so we never read past the NUL terminator.
+
+static const char *skip_whitespace_scalar(const char *p, const char *end, int *lines);
+static const char *skip_comment_scalar(const char *p, const char *end);
+static const char *skip_string_scalar(const char *p, const char *end);
+static const char *skip_identifier_scalar(const char *p, const char *end);
+
+static const vmake_scan_kernels scalar_kernels = {
+    skip_whitespace_scalar,
+    skip_comment_scalar,
+    skip_string_scalar,
+    skip_identifier_scalar,
+};
+
+static const char *skip_whitespace_scalar(const char *p, const char *end, int *lines) {
+  for (; p < end; p++) {
+    switch (*p) {
+    case '\n':
+      (*lines)++;
+      break;
+    case ' ':
+    case '\t':
+    case '\r':
+      break;
+    default:
+      return p;
+    }
+  }
+  return p;
+}
+
+static const char *skip_comment_scalar(const char *p, const char *end) {
+  while (p < end && *p != '\n' && *p != '\0')
+    p++;
+  return p;
+}
+
+static const char *skip_string_scalar(const char *p, const char *end) {
+  while (p < end && *p != '"' && *p != '\0')
+    p++;
+  return p;
+}
+
+static const char *skip_identifier_scalar(const char *p, const char *end) {
+  while (p < end && (*p == '_' || isalnum((unsigned char)*p)))
+    p++;
+  return p;
+}
+
+#ifdef VMAKE_SCAN_X86
+
+#define TARGET(isa) __attribute__((target(isa)))
+
+TARGET("sse2")
+static const char *skip_whitespace_sse2(const char *p, const char *end, int *lines) {
+  while (end - p >= 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)p);
+    __m128i newlines = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+    __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+                                  _mm_cmpeq_epi8(block, _mm_set1_epi8('\t')));
+    __m128i returns = _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'));
+    __m128i blanks = _mm_or_si128(_mm_or_si128(spaces, returns), newlines);
+    uint32_t newline_mask = _mm_movemask_epi8(newlines);
+    uint32_t stop_mask = ~_mm_movemask_epi8(blanks) & 0xFFFF;
+    if (stop_mask != 0) {
+      int index = __builtin_ctz(stop_mask);
+      *lines += __builtin_popcount(newline_mask & ((1u << index) - 1));
+      return p + index;
+    }
+    *lines += __builtin_popcount(newline_mask);
+    p += 16;
+  }
+  return skip_whitespace_scalar(p, end, lines);
+}
+
+TARGET("sse2") static const char *skip_until_sse2(const char *p, const char *end, char c) {
+  while (end - p >= 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)p);
+    __m128i stops = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(c)),
+                                 _mm_cmpeq_epi8(block, _mm_setzero_si128()));
+    uint32_t stop_mask = _mm_movemask_epi8(stops);
+    if (stop_mask != 0)
+      return p + __builtin_ctz(stop_mask);
+    p += 16;
+  }
+  return p;
+}
+
+TARGET("sse2") static const char *skip_comment_sse2(const char *p, const char *end) {
+  return skip_comment_scalar(skip_until_sse2(p, end, '\n'), end);
+}
+
+TARGET("sse2") static const char *skip_string_sse2(const char *p, const char *end) {
+  return skip_string_scalar(skip_until_sse2(p, end, '"'), end);
+}
+
+TARGET("sse2") static const char *skip_identifier_sse2(const char *p, const char *end) {
+  while (end - p >= 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)p);
+    // Setting bit 5 maps upper case letters to lower case letters without mapping anything else
+    // into the a-z range. Bytes above 0x7F are negative, so they fail every range check.
+    __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(block, _mm_set1_epi8('9' + 1)));
+    __m128i underscore = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+    __m128i word = _mm_or_si128(_mm_or_si128(alpha, digit), underscore);
+    uint32_t stop_mask = ~_mm_movemask_epi8(word) & 0xFFFF;
+    if (stop_mask != 0)
+      return p + __builtin_ctz(stop_mask);
+    p += 16;
+  }
+  return skip_identifier_scalar(p, end);
+}
+
+static const vmake_scan_kernels sse2_kernels = {
+    skip_whitespace_sse2,
+    skip_comment_sse2,
+    skip_string_sse2,
+    skip_identifier_sse2,
+};
+
+TARGET("avx2")
+static const char *skip_whitespace_avx2(const char *p, const char *end, int *lines) {
+  while (end - p >= 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)p);
+    __m256i newlines = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'));
+    __m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')),
+                                     _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')));
+    __m256i returns = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r'));
+    __m256i blanks = _mm256_or_si256(_mm256_or_si256(spaces, returns), newlines);
+    uint32_t newline_mask = _mm256_movemask_epi8(newlines);
+    uint32_t stop_mask = ~(uint32_t)_mm256_movemask_epi8(blanks);
+    if (stop_mask != 0) {
+      int index = __builtin_ctz(stop_mask);
+      *lines += __builtin_popcount(newline_mask & ((1u << index) - 1));
+      return p + index;
+    }
+    *lines += __builtin_popcount(newline_mask);
+    p += 32;
+  }
+  return skip_whitespace_sse2(p, end, lines);
+}
+
+TARGET("avx2") static const char *skip_until_avx2(const char *p, const char *end, char c) {
+  while (end - p >= 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)p);
+    __m256i stops = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(c)),
+                                    _mm256_cmpeq_epi8(block, _mm256_setzero_si256()));
+    uint32_t stop_mask = _mm256_movemask_epi8(stops);
+    if (stop_mask != 0)
+      return p + __builtin_ctz(stop_mask);
+    p += 32;
+  }
+  return p;
+}
+
+TARGET("avx2") static const char *skip_comment_avx2(const char *p, const char *end) {
+  return skip_comment_sse2(skip_until_avx2(p, end, '\n'), end);
+}
+
+TARGET("avx2") static const char *skip_string_avx2(const char *p, const char *end) {
+  return skip_string_sse2(skip_until_avx2(p, end, '"'), end);
+}
+
+TARGET("avx2") static const char *skip_identifier_avx2(const char *p, const char *end) {
+  while (end - p >= 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)p);
+    // See skip_identifier_sse2. AVX2 has no "less than" comparison, so the operands are swapped.
+    __m256i lower = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), block));
+    __m256i underscore = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_'));
+    __m256i word = _mm256_or_si256(_mm256_or_si256(alpha, digit), underscore);
+    uint32_t stop_mask = ~(uint32_t)_mm256_movemask_epi8(word);
+    if (stop_mask != 0)
+      return p + __builtin_ctz(stop_mask);
+    p += 32;
+  }
+  return skip_identifier_sse2(p, end);
+}
+
+static const vmake_scan_kernels avx2_kernels = {
+    skip_whitespace_avx2,
+    skip_comment_avx2,
+    skip_string_avx2,
+    skip_identifier_avx2,
+};
+
+#endif
+
+const vmake_scan_kernels *vmake_scan_kernels_get(void) {
+#ifdef VMAKE_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return &avx2_kernels;
+  if (__builtin_cpu_supports("sse2"))
+    return &sse2_kernels;
+#endif
+  return &scalar_kernels;
+}
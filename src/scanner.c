@@ -1,5 +1,8 @@
 #include "scanner.h"
+#include "hash.h"
+#include "keyword-table.h"
 #include "scanner-priv.h"
+#include "scanner-simd.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,41 +14,24 @@ static char peek(vmake_scanner *scanner);
 static bool is_eof(vmake_scanner *scanner);
 static bool match(vmake_scanner *scanner, char c);
 
-char *read_file(const char *path, size_t *file_size) {
-  FILE *file = fopen(path, "r");
-  if (!file) {
-    fprintf(stderr,
-            "An error occurred while trying to open file at '%s'. The file either doesn't exist or "
-            "requires elevated permissions.\n",
-            path);
-    exit(1);
-  }
-  fseek(file, 0, SEEK_END);
-  size_t size = ftell(file);
-  rewind(file);
-  char *source = malloc(sizeof(char) * (size + 1));
-  if (source == NULL) {
-    fprintf(stderr, "Could not allocate buffer to store file at \"%s\"\n", path);
-    exit(1);
-  }
-  size_t bytes_read = fread(source, sizeof(char), size, file);
-  if (bytes_read < size) {
-    fprintf(stderr, "Could not read file at '%s'\n", path);
-    exit(1);
-  }
-  source[bytes_read] = '\0';
-  fclose(file);
+static void token_buffer_push(vmake_token_buffer *buf, vmake_token token);
+static double parse_number(const char *start, int length);
+
+static const vmake_scan_kernels *kernels = NULL;
 
-  if (file_size != NULL)
-    *file_size = size;
-  return source;
+void vmake_scanner_setup(void) {
+  if (kernels == NULL)
+    kernels = vmake_scan_kernels_get();
 }
 
-vmake_scanner vmake_init_scanner(const char *source) {
+vmake_scanner vmake_init_scanner(const char *source, size_t length) {
   vmake_scanner scanner;
 
+  vmake_scanner_setup();
+
   scanner.current_char = source;
   scanner.token_start = source;
+  scanner.source_end = source + length;
   scanner.line = 0;
 
   return scanner;
@@ -101,6 +87,10 @@ vmake_token vmake_scan_token(vmake_scanner *scanner) {
     return make_token(scanner, TOKEN_LEFT_SQUARE_BRACKET);
   case ']':
     return make_token(scanner, TOKEN_RIGHT_SQUARE_BRACKET);
+  case '{':
+    return make_token(scanner, TOKEN_LEFT_BRACE);
+  case '}':
+    return make_token(scanner, TOKEN_RIGHT_BRACE);
   case '"':
     return make_string(scanner);
   }
@@ -108,26 +98,137 @@ vmake_token vmake_scan_token(vmake_scanner *scanner) {
   return make_token(scanner, TOKEN_ERROR);
 }
 
-static void consume_ignored(vmake_scanner *scanner) {
-  while (true) {
-    char c = peek(scanner);
-    switch (c) {
-    case '\n':
-      scanner->line++;
-      consume(scanner);
-      break;
-    case ' ':
-    case '\t':
-    case '\r':
-      consume(scanner);
+void vmake_token_buffer_scan(vmake_token_buffer *buf, const char *source, size_t length) {
+  if (length > UINT32_MAX) {
+    fprintf(stderr, "Source files larger than 4 GiB are not supported.\n");
+    exit(1);
+  }
+
+  buf->source = source;
+  buf->count = 0;
+  buf->borrowed = false;
+  // Most tokens are a few characters long and separated by whitespace, so this avoids growing the
+  // buffer several times for larger files.
+  buf->capacity = length / 4 < 8 ? 8 : length / 4;
+  buf->types = malloc(sizeof(uint8_t) * buf->capacity);
+  buf->offsets = malloc(sizeof(uint32_t) * buf->capacity);
+  buf->lengths = malloc(sizeof(uint32_t) * buf->capacity);
+  buf->lines = malloc(sizeof(uint32_t) * buf->capacity);
+  buf->values = malloc(sizeof(vmake_token_value) * buf->capacity);
+
+  vmake_scanner scanner = vmake_init_scanner(source, length);
+  vmake_token token;
+  do {
+    token = vmake_scan_token(&scanner);
+    switch (token.type) {
+    case TOKEN_NUMBER:
+      token.value.number = parse_number(token.name, token.name_length);
       break;
-    case '#':
-      while (peek(scanner) != '\n' && !is_eof(scanner))
-        consume(scanner);
+    case TOKEN_IDENTIFIER:
+    case TOKEN_STRING:
+      token.value.hash = vmake_hash_chars(token.name, token.name_length);
       break;
     default:
-      return;
+      break;
     }
+    token_buffer_push(buf, token);
+  } while (token.type != TOKEN_EOF);
+}
+
+void vmake_token_buffer_free(vmake_token_buffer *buf) {
+  if (!buf->borrowed) {
+    free(buf->types);
+    free(buf->offsets);
+    free(buf->lengths);
+    free(buf->lines);
+    free(buf->values);
+  }
+  buf->count = 0;
+  buf->capacity = 0;
+}
+
+vmake_token vmake_token_buffer_get(vmake_token_buffer *buf, int index) {
+  vmake_token token;
+  if (index < 0) {
+    token.type = TOKEN_NONE;
+    token.name = buf->source;
+    token.name_length = 0;
+    token.line = 0;
+    token.value.number = 0;
+    return token;
+  }
+
+  token.type = buf->types[index];
+  token.name = buf->source + buf->offsets[index];
+  token.name_length = buf->lengths[index];
+  token.line = buf->lines[index];
+  token.value = buf->values[index];
+  return token;
+}
+
+static void token_buffer_push(vmake_token_buffer *buf, vmake_token token) {
+  if (buf->count + 1 > buf->capacity) {
+    buf->capacity *= 2;
+    buf->types = reallocarray(buf->types, buf->capacity, sizeof(uint8_t));
+    buf->offsets = reallocarray(buf->offsets, buf->capacity, sizeof(uint32_t));
+    buf->lengths = reallocarray(buf->lengths, buf->capacity, sizeof(uint32_t));
+    buf->lines = reallocarray(buf->lines, buf->capacity, sizeof(uint32_t));
+    buf->values = reallocarray(buf->values, buf->capacity, sizeof(vmake_token_value));
+  }
+
+  buf->types[buf->count] = token.type;
+  buf->offsets[buf->count] = token.name - buf->source;
+  buf->lengths[buf->count] = token.name_length;
+  buf->lines[buf->count] = token.line;
+  buf->values[buf->count] = token.value;
+  buf->count++;
+}
+
+static double parse_number(const char *start, int length) {
+  // Powers of ten that are exactly representable as doubles.
+  static const double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                         1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                         1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  // Number tokens are digits, optionally followed by a dot and more digits. If all the digits fit
+  // in a mantissa that a double represents exactly, and the divisor is an exact power of ten, a
+  // single division is correctly rounded and gives the same result as strtod.
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int fraction_digits = 0;
+  bool in_fraction = false;
+  for (int i = 0; i < length; i++) {
+    if (start[i] == '.') {
+      in_fraction = true;
+      continue;
+    }
+    if (digits == 0 && start[i] == '0' && !in_fraction)
+      continue;
+    mantissa = mantissa * 10 + (start[i] - '0');
+    digits++;
+    if (in_fraction)
+      fraction_digits++;
+    if (digits > 15)
+      break;
+  }
+
+  if (digits <= 15 && fraction_digits <= 22)
+    return (double)mantissa / powers_of_ten[fraction_digits];
+
+  // The token isn't NUL-terminated, so strtod needs its own copy.
+  char *copy = strndup(start, length);
+  double number = strtod(copy, NULL);
+  free(copy);
+  return number;
+}
+
+static void consume_ignored(vmake_scanner *scanner) {
+  while (true) {
+    scanner->current_char =
+        kernels->skip_whitespace(scanner->current_char, scanner->source_end, &scanner->line);
+    if (peek(scanner) != '#')
+      return;
+    scanner->current_char = kernels->skip_comment(scanner->current_char, scanner->source_end);
   }
 }
 
@@ -166,50 +267,37 @@ vmake_token make_number(vmake_scanner *scanner) {
 }
 
 vmake_token make_identifier(vmake_scanner *scanner) {
-  while (is_identifier_char(peek(scanner), false)) {
-    consume(scanner);
-  }
+  scanner->current_char = kernels->skip_identifier(scanner->current_char, scanner->source_end);
 
   return make_token(scanner, identifier_type(scanner));
 }
 
 vmake_token make_string(vmake_scanner *scanner) {
-  char c;
-  do {
-    c = consume(scanner);
-  } while (c != '"' && c != '\0');
+  scanner->current_char = kernels->skip_string(scanner->current_char, scanner->source_end);
+  // An unterminated string ends at the end of the file, in which case there's no " to consume.
+  bool terminated = match(scanner, '"');
 
   // Get rid of the " at the beginning.
   scanner->token_start++;
   vmake_token token = make_token(scanner, TOKEN_STRING);
   // Get rid of the " at the end.
-  token.name_length--;
+  if (terminated)
+    token.name_length--;
   return token;
 }
 
 vmake_token_type identifier_type(vmake_scanner *scanner) {
-  switch (*scanner->token_start) {
-  case 'f':
-    return check_keyword(scanner, 1, 4, "alse", TOKEN_FALSE);
-  case 'i':
-    return check_keyword(scanner, 1, 6, "nclude", TOKEN_INCLUDE);
-  case 'n':
-    return check_keyword(scanner, 1, 2, "il", TOKEN_NIL);
-  case 'p':
-    return check_keyword(scanner, 1, 4, "rint", TOKEN_PRINT);
-  case 't':
-    return check_keyword(scanner, 1, 3, "rue", TOKEN_TRUE);
-  }
-
-  return TOKEN_IDENTIFIER;
+  return vmake_keyword_type(scanner->token_start, scanner->current_char - scanner->token_start);
 }
 
-vmake_token_type check_keyword(vmake_scanner *scanner, int start, int length, const char *rest,
-                               vmake_token_type type) {
-  if (scanner->current_char - scanner->token_start == start + length &&
-      memcmp(scanner->token_start + start, rest, length) == 0) {
-    return type;
-  }
+vmake_token_type vmake_keyword_type(const char *start, int length) {
+  if (length < VMAKE_KEYWORD_MIN_LENGTH || length > VMAKE_KEYWORD_MAX_LENGTH)
+    return TOKEN_IDENTIFIER;
+
+  const vmake_keyword *keyword = &vmake_keyword_table[vmake_keyword_hash(
+      start, length, VMAKE_KEYWORD_SEED, VMAKE_KEYWORD_SHIFT)];
+  if (keyword->length == length && memcmp(keyword->name, start, length) == 0)
+    return keyword->type;
 
   return TOKEN_IDENTIFIER;
 }
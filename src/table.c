@@ -1,28 +1,54 @@
 #include "table.h"
-#include "object.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
-
-#define TOMBSTONE ((void *)1)
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Control bytes of slots without an entry. Full slots hold the 7 bits of H2, so their sign bit is
+// never set.
+#define CONTROL_EMPTY ((int8_t)-128)
+#define CONTROL_DELETED ((int8_t)-2)
+#define NOT_FOUND -1
+
+static uint32_t h1(uint32_t hash);
+static int8_t h2(uint32_t hash);
+static uint32_t match_byte(const int8_t *group, int8_t byte);
+static uint32_t match_free(const int8_t *group);
+static int find_slot(vmake_table *table, vmake_value key, uint32_t hash);
+static int find_free_slot(const vmake_table *table, uint32_t hash);
+static void set_slot(vmake_table *table, int slot, uint32_t hash, int index);
+static int allocate_entry(vmake_table *table);
+static void reserve_slot(vmake_table *table);
 
 void vmake_table_init(vmake_table *table) {
-  table->capacity = 0;
   table->count = 0;
-  table->entries = NULL;
+  table->capacity = 0;
+  table->deleted = 0;
+  table->control = NULL;
+  table->slots = NULL;
+  table->entry_count = 0;
+  table->page_count = 0;
+  table->pages = NULL;
+  table->free_entry = NOT_FOUND;
 }
 
 void vmake_table_free(vmake_table *table) {
-  free(table->entries);
+  for (int i = 0; i < table->page_count; i++) {
+    free(table->pages[i]);
+  }
+  free(table->pages);
+  free(table->control);
+  free(table->slots);
   vmake_table_init(table);
 }
 
 void vmake_table_copy_to(vmake_table *from, vmake_table *to) {
-  for (int i = 0; i < from->capacity; i++) {
-    vmake_table_entry entry = from->entries[i];
-    if (entry.key.type != VAL_EMPTY) {
-      vmake_table_put_ptr(to, entry.key, entry.value);
-    }
+  for (int i = 0; i < from->entry_count; i++) {
+    vmake_table_entry *entry = vmake_table_entry_at(from, i);
+    if (!vmake_value_is_empty(entry->key))
+      vmake_table_put_cpy(to, entry->key, entry->value);
   }
 }
 
@@ -41,65 +67,68 @@ bool vmake_table_put_ptr(vmake_table *table, vmake_value key, vmake_value *value
 
 bool vmake_table_put_ret(vmake_table *table, vmake_value key, vmake_value *value,
                          vmake_value **inserted) {
-  if (table->count + 1 > table->capacity * VMAKE_TABLE_LOAD_FACTOR) {
-    int capacity = table->capacity < 8 ? 8 : table->capacity * 2;
-    vmake_table_resize(table, capacity);
-  }
-
-  vmake_table_entry *entry = vmake_table_find_entry(table->entries, table->capacity, key);
-  bool is_new_key = entry->key.type == VAL_EMPTY;
-  // Only increment the count if the entry is not a tombstone entry, because
-  // removing entries does not decrease the count
-  if (is_new_key && entry->value == NULL)
+  assert(!vmake_value_is_empty(key));
+
+  uint32_t hash = vmake_value_hash(key);
+  int slot = find_slot(table, key, hash);
+  bool is_new_key = slot == NOT_FOUND;
+  vmake_table_entry *entry;
+  if (is_new_key) {
+    reserve_slot(table);
+    int index = allocate_entry(table);
+    set_slot(table, find_free_slot(table, hash), hash, index);
+    entry = vmake_table_entry_at(table, index);
+    entry->key = key;
     table->count++;
-
-  entry->key = key;
-  entry->value = malloc(sizeof(vmake_value));
-  if (value == NULL || value == TOMBSTONE) {
-    entry->value = value;
   } else {
-    *entry->value = *value;
+    entry = vmake_table_entry_at(table, table->slots[slot]);
   }
 
+  entry->value = value == NULL ? vmake_value_nil() : *value;
   if (inserted)
-    *inserted = entry->value;
+    *inserted = &entry->value;
 
   return is_new_key;
 }
 
 bool vmake_table_remove(vmake_table *table, vmake_value key) {
-  if (table->count == 0)
+  int slot = find_slot(table, key, vmake_value_hash(key));
+  if (slot == NOT_FOUND)
     return false;
 
-  vmake_table_entry *entry = vmake_table_find_entry(table->entries, table->capacity, key);
-  if (entry->key.type == VAL_EMPTY)
-    return false;
+  // Lookups stop at the first group with an empty slot, so a slot in such a group can be emptied
+  // instead of leaving a tombstone that lookups have to skip.
+  int8_t *group = table->control + (slot & ~(VMAKE_TABLE_GROUP_SIZE - 1));
+  if (match_byte(group, CONTROL_EMPTY) != 0) {
+    table->control[slot] = CONTROL_EMPTY;
+  } else {
+    table->control[slot] = CONTROL_DELETED;
+    table->deleted++;
+  }
 
+  int index = table->slots[slot];
+  vmake_table_entry *entry = vmake_table_entry_at(table, index);
   entry->key = vmake_value_empty();
-  // 'Tombstone' value to indicate that there used to be a value at this entry
-  entry->value = TOMBSTONE;
-
+  entry->value = vmake_value_number(table->free_entry);
+  table->free_entry = index;
+  table->count--;
   return true;
 }
 
 bool vmake_table_get(vmake_table *table, vmake_value key, vmake_value **value) {
-  if (table->count == 0)
-    return false;
-
-  vmake_table_entry *entry = vmake_table_find_entry(table->entries, table->capacity, key);
-  if (entry->key.type == VAL_EMPTY)
+  int slot = find_slot(table, key, vmake_value_hash(key));
+  if (slot == NOT_FOUND)
     return false;
 
   if (value != NULL)
-    *value = entry->value;
+    *value = &vmake_table_entry_at(table, table->slots[slot])->value;
   return true;
 }
 
 bool vmake_table_get_or_nil(vmake_table *table, vmake_value key, vmake_value **value) {
   bool ret = vmake_table_get(table, key, value);
-  if (*value == NULL) {
+  if (!ret)
     vmake_table_put_cpy_ret(table, key, vmake_value_nil(), value);
-  }
   return ret;
 }
 
@@ -107,79 +136,129 @@ bool vmake_table_has(vmake_table *table, vmake_value key) {
   return vmake_table_get(table, key, NULL);
 }
 
-vmake_table_entry *vmake_table_find_entry(vmake_table_entry *entries, int capacity,
-                                          vmake_value key) {
-  if (capacity == 0)
-    return NULL;
+size_t vmake_table_bytes(const vmake_table *table) {
+  return (size_t)table->capacity * (sizeof(int8_t) + sizeof(uint32_t)) +
+         (size_t)table->page_count *
+             (sizeof(vmake_table_entry *) + sizeof(vmake_table_entry) * VMAKE_TABLE_PAGE_SIZE);
+}
 
-  assert(key.type != VAL_EMPTY);
+void vmake_table_resize(vmake_table *table, int new_capacity) {
+  free(table->control);
+  free(table->slots);
+  table->control = aligned_alloc(VMAKE_TABLE_GROUP_SIZE, new_capacity);
+  memset(table->control, CONTROL_EMPTY, new_capacity);
+  table->slots = malloc(sizeof(uint32_t) * new_capacity);
+  table->capacity = new_capacity;
+  table->deleted = 0;
 
-  // This only works instead of the modulo operator because we know that capacity is a power of 2
-  int index = vmake_value_hash(key) & (capacity - 1);
-  vmake_table_entry *tombstone = NULL;
+  // Keys in the table are all different, so they don't need to be compared while reinserting them.
+  for (int i = 0; i < table->entry_count; i++) {
+    vmake_table_entry *entry = vmake_table_entry_at(table, i);
+    if (vmake_value_is_empty(entry->key))
+      continue;
+    uint32_t hash = vmake_value_hash(entry->key);
+    set_slot(table, find_free_slot(table, hash), hash, i);
+  }
+}
 
-  while (true) {
-    vmake_table_entry *entry = &entries[index];
-    if (entry->key.type == VAL_EMPTY) {
-      if (entry->value == NULL) {
-        return tombstone == NULL ? entry : tombstone;
-      } else if (entry->value == TOMBSTONE && tombstone == NULL) {
-        tombstone = entry;
-      }
-    } else if (vmake_value_equals(entry->key, key)) {
-      return entry;
-    }
+// The hash is split in two: H1 picks the group where probing starts, and H2 is stored in the
+// control byte.
+static uint32_t h1(uint32_t hash) { return hash; }
+
+static int8_t h2(uint32_t hash) { return hash >> 25; }
+
+// Returns a mask with a bit set for every control byte of the group that equals `byte`.
+static uint32_t match_byte(const int8_t *group, int8_t byte) {
+#ifdef __SSE2__
+  __m128i control = _mm_load_si128((const __m128i *)group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(byte)));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < VMAKE_TABLE_GROUP_SIZE; i++) {
+    mask |= (uint32_t)(group[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
 
-    index = (index + 1) & (capacity - 1);
+// Returns a mask with a bit set for every empty or deleted slot of the group, which are the control
+// bytes with their sign bit set.
+static uint32_t match_free(const int8_t *group) {
+#ifdef __SSE2__
+  return _mm_movemask_epi8(_mm_load_si128((const __m128i *)group));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < VMAKE_TABLE_GROUP_SIZE; i++) {
+    mask |= (uint32_t)(group[i] < 0) << i;
   }
+  return mask;
+#endif
 }
 
-vmake_obj_string *vmake_table_find_string(vmake_table *table, const char *chars, int length,
-                                          uint32_t hash) {
+static int find_slot(vmake_table *table, vmake_value key, uint32_t hash) {
   if (table->count == 0)
-    return NULL;
-
-  int index = hash & (table->capacity - 1);
-
-  while (true) {
-    vmake_table_entry *entry = &table->entries[index];
-    if (entry->key.type == VAL_EMPTY) {
-      // If the entry is not a tombstone and is empty, that means we haven't
-      // found anything.
-      if (entry->value == NULL) {
-        return NULL;
-      }
-    } else if (vmake_value_is_string(entry->key)) {
-      vmake_obj_string *str = (vmake_obj_string *)entry->key.as.obj;
-      if (str->length == length && str->hash == hash && memcmp(str->chars, chars, length) == 0) {
-        return str;
-      }
+    return NOT_FOUND;
+
+  // Groups are probed quadratically, which visits every group since their count is a power of 2.
+  int group_mask = table->capacity / VMAKE_TABLE_GROUP_SIZE - 1;
+  int group = h1(hash) & group_mask;
+  for (int step = 1;; step++) {
+    const int8_t *control = table->control + group * VMAKE_TABLE_GROUP_SIZE;
+    for (uint32_t match = match_byte(control, h2(hash)); match != 0; match &= match - 1) {
+      int slot = group * VMAKE_TABLE_GROUP_SIZE + __builtin_ctz(match);
+      if (vmake_value_equals(vmake_table_entry_at(table, table->slots[slot])->key, key))
+        return slot;
     }
-
-    index = (index + 1) & (table->capacity - 1);
+    if (match_byte(control, CONTROL_EMPTY) != 0)
+      return NOT_FOUND;
+    group = (group + step) & group_mask;
   }
 }
 
-void vmake_table_resize(vmake_table *table, int new_capacity) {
-  vmake_table_entry *entries = malloc(sizeof(vmake_table_entry) * new_capacity);
-  for (int i = 0; i < new_capacity; i++) {
-    entries[i].key = vmake_value_empty();
-    entries[i].value = NULL;
+// Returns the first empty or deleted slot on the probe sequence of `hash`. There always is one,
+// since the table is never full.
+static int find_free_slot(const vmake_table *table, uint32_t hash) {
+  int group_mask = table->capacity / VMAKE_TABLE_GROUP_SIZE - 1;
+  int group = h1(hash) & group_mask;
+  for (int step = 1;; step++) {
+    uint32_t match = match_free(table->control + group * VMAKE_TABLE_GROUP_SIZE);
+    if (match != 0)
+      return group * VMAKE_TABLE_GROUP_SIZE + __builtin_ctz(match);
+    group = (group + step) & group_mask;
   }
+}
 
-  table->count = 0;
-  for (int i = 0; i < table->capacity; i++) {
-    vmake_table_entry entry = table->entries[i];
-    if (entry.key.type == VAL_EMPTY)
-      continue;
+static void set_slot(vmake_table *table, int slot, uint32_t hash, int index) {
+  if (table->control[slot] == CONTROL_DELETED)
+    table->deleted--;
+  table->control[slot] = h2(hash);
+  table->slots[slot] = index;
+}
 
-    vmake_table_entry *new_entry = vmake_table_find_entry(entries, new_capacity, entry.key);
-    new_entry->key = entry.key;
-    new_entry->value = entry.value;
-    table->count++;
+static int allocate_entry(vmake_table *table) {
+  if (table->free_entry != NOT_FOUND) {
+    int index = table->free_entry;
+    table->free_entry = vmake_value_as_number(vmake_table_entry_at(table, index)->value);
+    return index;
   }
 
-  free(table->entries);
-  table->entries = entries;
-  table->capacity = new_capacity;
+  if (table->entry_count == table->page_count * VMAKE_TABLE_PAGE_SIZE) {
+    table->pages = reallocarray(table->pages, table->page_count + 1, sizeof(vmake_table_entry *));
+    table->pages[table->page_count++] = malloc(sizeof(vmake_table_entry) * VMAKE_TABLE_PAGE_SIZE);
+  }
+  return table->entry_count++;
+}
+
+// Makes sure there's a free slot for one more entry, growing the table once too many slots are
+// full or deleted. If it's mostly tombstones that fill the table, it's rehashed at the same size
+// instead of growing.
+static void reserve_slot(vmake_table *table) {
+  if ((table->count + table->deleted + 1) * VMAKE_TABLE_MAX_LOAD_DEN <=
+      table->capacity * VMAKE_TABLE_MAX_LOAD_NUM)
+    return;
+
+  int capacity = table->capacity == 0 ? VMAKE_TABLE_GROUP_SIZE : table->capacity;
+  if ((table->count + 1) * 2 > capacity)
+    capacity = table->capacity == 0 ? capacity : capacity * 2;
+  vmake_table_resize(table, capacity);
 }
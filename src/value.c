@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+static uint32_t mix(uint64_t bits);
+
 char *vmake_value_type_to_string(vmake_value_type type) {
   switch (type) {
   case VAL_EMPTY:
@@ -19,56 +21,45 @@ char *vmake_value_type_to_string(vmake_value_type type) {
   }
 }
 
-vmake_value vmake_value_empty() { return (vmake_value){VAL_EMPTY, {.number = 0}}; }
-
-vmake_value vmake_value_number(double number) {
-  return (vmake_value){VAL_NUMBER, {.number = number}};
-}
-
-vmake_value vmake_value_bool(bool boolean) { return (vmake_value){VAL_BOOL, {.boolean = boolean}}; }
-
-vmake_value vmake_value_nil() { return (vmake_value){VAL_NIL, {.number = 0}}; }
-
-vmake_value vmake_value_obj(vmake_obj *obj) { return (vmake_value){VAL_OBJ, {.obj = obj}}; }
-
-bool vmake_value_is_obj(vmake_value val) { return val.type == VAL_OBJ; }
-
 bool vmake_value_is_string(vmake_value val) {
-  return vmake_value_is_obj(val) && val.as.obj->type == OBJ_STRING;
+  return vmake_value_is_obj(val) && vmake_value_as_obj(val)->type == OBJ_STRING;
 }
 
 bool vmake_value_is_native(vmake_value val) {
-  return vmake_value_is_obj(val) && val.as.obj->type == OBJ_NATIVE;
+  return vmake_value_is_obj(val) && vmake_value_as_obj(val)->type == OBJ_NATIVE;
 }
 
 bool vmake_value_is_array(vmake_value val) {
-  return vmake_value_is_obj(val) && val.as.obj->type == OBJ_ARRAY;
+  return vmake_value_is_obj(val) && vmake_value_as_obj(val)->type == OBJ_ARRAY;
+}
+
+bool vmake_value_is_table(vmake_value val) {
+  return vmake_value_is_obj(val) && vmake_value_as_obj(val)->type == OBJ_TABLE;
 }
 
 bool vmake_value_is_instance(vmake_value val) {
-  return vmake_value_is_obj(val) && val.as.obj->type == OBJ_INSTANCE;
+  return vmake_value_is_obj(val) && vmake_value_as_obj(val)->type == OBJ_INSTANCE;
 }
 
 uint32_t vmake_value_hash(vmake_value val) {
-  switch (val.type) {
+  switch (vmake_value_get_type(val)) {
   case VAL_BOOL:
-    return val.as.boolean;
+    return mix(2 + vmake_value_as_bool(val));
   case VAL_NIL:
-    return 3;
+    return mix(1);
   case VAL_NUMBER: {
-    union bitcast {
-      double value;
-      uint32_t ints[2];
-    };
-
-    union bitcast cast;
-    cast.value = (val.as.number) + 1.0;
-    return cast.ints[0] + cast.ints[1];
+    // 0 and -0 are equal, so they must hash the same.
+    double number = vmake_value_as_number(val) + 0.0;
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(double));
+    return mix(bits);
+  }
+  case VAL_OBJ: {
+    vmake_obj *obj = vmake_value_as_obj(val);
+    if (obj->type == OBJ_STRING)
+      return ((vmake_obj_string *)obj)->hash;
+    return mix((uintptr_t)obj);
   }
-  case VAL_OBJ:
-    if (val.as.obj->type == OBJ_STRING)
-      return ((vmake_obj_string *)val.as.obj)->hash;
-    return (uint32_t)(intptr_t)val.as.obj;
   default:
     return 0;
   }
@@ -76,10 +67,10 @@ uint32_t vmake_value_hash(vmake_value val) {
 
 char *vmake_value_to_string(vmake_value val) {
   char *buf;
-  switch (val.type) {
+  switch (vmake_value_get_type(val)) {
   case VAL_NUMBER: {
     int len;
-    if ((len = asprintf(&buf, "%f", val.as.number)) == -1) {
+    if ((len = asprintf(&buf, "%f", vmake_value_as_number(val))) == -1) {
       fprintf(stderr, "An internal error occurred while trying to print a number.");
     }
     bool found_dot = false;
@@ -100,8 +91,8 @@ char *vmake_value_to_string(vmake_value val) {
     break;
   }
   case VAL_BOOL:
-    buf = malloc(sizeof(char) * ((val.as.boolean ? 4 : 5) + 1));
-    strcpy(buf, val.as.boolean ? "true" : "false");
+    buf = malloc(sizeof(char) * ((vmake_value_as_bool(val) ? 4 : 5) + 1));
+    strcpy(buf, vmake_value_as_bool(val) ? "true" : "false");
     break;
   case VAL_NIL:
     buf = malloc(sizeof(char) * 4);
@@ -112,7 +103,11 @@ char *vmake_value_to_string(vmake_value val) {
     strcpy(buf, "empty");
     break;
   case VAL_OBJ:
-    buf = vmake_obj_to_string(val.as.obj);
+    buf = vmake_obj_to_string(vmake_value_as_obj(val));
+    break;
+  default:
+    asprintf(&buf, "<value %s>", vmake_value_type_to_string(vmake_value_get_type(val)));
+    break;
   }
 
   return buf;
@@ -124,31 +119,11 @@ void vmake_value_print(vmake_value val) {
   free(buf);
 }
 
-bool vmake_value_equals(vmake_value a, vmake_value b) {
-  if (a.type != b.type)
-    return false;
-
-  switch (a.type) {
-  case VAL_NUMBER:
-    return a.as.number == b.as.number;
-  case VAL_BOOL:
-    return a.as.boolean == b.as.boolean;
-  case VAL_NIL:
-    return true;
-  case VAL_OBJ:
-    return a.as.obj == b.as.obj;
-  case VAL_EMPTY:
-    return false;
-  }
-
-  return false;
-}
-
 int vmake_value_compare(vmake_value a, vmake_value b) {
-  switch (a.type) {
+  switch (vmake_value_get_type(a)) {
   case VAL_NUMBER: {
-    double x = a.as.number;
-    double y = b.as.number;
+    double x = vmake_value_as_number(a);
+    double y = vmake_value_as_number(b);
     return x == y ? 0 : x > y ? 1 : -1;
   }
   case VAL_BOOL:
@@ -159,3 +134,15 @@ int vmake_value_compare(vmake_value a, vmake_value b) {
     break;
   }
 }
+
+// The finalizer of MurmurHash3, which spreads every input bit over the whole hash. Tables take
+// their probe start from the low bits and their control bytes from the high bits, so numbers and
+// aligned pointers, which differ only in a few bits, would otherwise collide.
+static uint32_t mix(uint64_t bits) {
+  bits ^= bits >> 33;
+  bits *= 0xff51afd7ed558ccdULL;
+  bits ^= bits >> 33;
+  bits *= 0xc4ceb9fe1a85ec53ULL;
+  bits ^= bits >> 33;
+  return (uint32_t)bits;
+}
@@ -1,7 +1,9 @@
+#include "cache.h"
 #include "common.h"
 #include "config.h"
 #include "file.h"
 #include "generator.h"
+#include "native/fun.h"
 #include "object.h"
 #include "scanner-priv.h"
 #include "scanner.h"
@@ -20,19 +22,27 @@ int main(int argc, char *argv[]) {
 
   vmake_state state;
   vmake_table_init(&state.globals);
-  vmake_table_init(&state.strings);
-  vmake_value_array_new(&state.include_stack);
+  vmake_value_array_new(&state.global_values);
+  vmake_interner_init(&state.strings);
+  vmake_module_table_init(&state.modules);
   vmake_value_array_new(&state.make.targets);
   state.had_error = false;
   state.panic_mode = false;
   state.objects = NULL;
+  vmake_arena_init(&state.arena);
+  vmake_gc_init(&state.gc);
+  state.vm = NULL;
+  state.sources = NULL;
   state.argc = argc;
   state.argv = argv;
+  vmake_atoms_init(&state);
+  // Builtins are globals like any other, shared by every file the state runs.
+  vmake_define_native_classes(&state);
+  vmake_define_native_functions(&state);
 
   argv[1] = realpath(argv[1], NULL);
   state.root_file = argv[1];
-  vmake_process_path(&state, argv[1]);
-  char *path_copy = strdup(argv[1]);
+  state.cache_directory = NULL;
   if (argc == 4) {
     char *src = realpath(argv[2], NULL);
     if (src == NULL)
@@ -42,28 +52,84 @@ int main(int argc, char *argv[]) {
     if (build == NULL)
       vmake_error_exit(NULL, CTX_USER, NULL, "Directory at '%s' doesn't exist", argv[3]);
     argv[3] = build;
+    // Compiled files are only cached when we're given a build directory, so that we never write
+    // anything to the source tree.
+    state.cache_directory = malloc(strlen(build) + sizeof("/" VMAKE_CACHE_DIRECTORY));
+    sprintf(state.cache_directory, "%s/" VMAKE_CACHE_DIRECTORY, build);
+  }
+
+  vmake_process_path(&state, argv[1]);
+  char *path_copy = strdup(argv[1]);
+  if (argc == 4) {
     vmake_build_makefiles(&state, argv[3], argv[2]);
     free(argv[2]);
     free(argv[3]);
   } else {
-    vmake_build_makefiles(&state, dirname(path_copy), ".");
+    // Sources are compared against the source directory once they're absolute, so it has to be
+    // absolute too.
+    char *root_directory = dirname(path_copy);
+    vmake_build_makefiles(&state, root_directory, root_directory);
   }
   free(path_copy);
   free(argv[1]);
-
-  vmake_value_array_free(&state.make.targets);
-  vmake_value_array_free(&state.include_stack);
-  vmake_table_free(&state.strings);
-  vmake_table_free(&state.globals);
+  vmake_state_free(&state);
 
   return 0;
 }
 
+void vmake_state_free(vmake_state *state) {
+  free(state->cache_directory);
+  vmake_value_array_free(&state->make.targets);
+  vmake_module_table_free(&state->modules);
+  vmake_interner_free(&state->strings);
+  vmake_value_array_free(&state->global_values);
+  vmake_table_free(&state->globals);
+  vmake_objects_free(state);
+  vmake_gc_free(&state->gc);
+  // Strings may borrow characters from sources, so sources go last.
+  while (state->sources != NULL) {
+    vmake_source *next = state->sources->next;
+    vmake_source_free(state->sources);
+    state->sources = next;
+  }
+}
+
 void vmake_process_path(vmake_state *state, char *path) {
-  char *source = read_file(path, NULL);
-  vmake_scanner scanner = vmake_init_scanner(source);
-  vmake_generate_build(&scanner, state, path);
-  free(source);
+  vmake_module *module = vmake_module_get(&state->modules, path);
+  if (module == NULL)
+    vmake_error_exit(NULL, CTX_USER, NULL, "No file with path '%s' was found", path);
+  vmake_module_prepare(state, module);
+  vmake_process_module(state, module);
+}
+
+void vmake_process_module(vmake_state *state, vmake_module *module) {
+  vmake_module_load(state, module);
+  if (!module->compiled) {
+    vmake_chunk_init(&module->chunk);
+    if (vmake_compile(module, state))
+      vmake_cache_store(state, module->source, module->hash, &module->tokens, &module->chunk);
+    module->compiled = true;
+  }
+
+  module->active = true;
+  vmake_generate_build(module, state);
+  module->active = false;
+  module->run_count++;
+}
+
+int vmake_global_slot(vmake_state *state, vmake_value name) {
+  vmake_value *slot = NULL;
+  if (vmake_table_get(&state->globals, name, &slot))
+    return vmake_value_as_number(*slot);
+
+  vmake_value_array_push(&state->global_values, vmake_value_nil());
+  vmake_table_put_cpy(&state->globals, name, vmake_value_number(state->global_values.size - 1));
+  return state->global_values.size - 1;
+}
+
+void vmake_define_global(vmake_state *state, vmake_value name, vmake_value value) {
+  int slot = vmake_global_slot(state, name);
+  state->global_values.values[slot] = value;
 }
 
 void vmake_verror(vmake_gen *gen, vmake_error_context context, vmake_token *token, const char *fmt,
@@ -113,12 +179,11 @@ void vmake_verror(vmake_gen *gen, vmake_error_context context, vmake_token *toke
   if (filename_is_path)
     free(filename);
   if (gen) {
-    for (int i = gen->state->include_stack.size - 2; i >= 0; i--) {
-      char *str = ((vmake_obj_string *)gen->state->include_stack.values[i].as.obj)->chars;
-      char *rel_path = vmake_path_abs_to_rel(str);
+    vmake_module *module = gen->module ? gen->module->included_from : NULL;
+    for (; module != NULL; module = module->included_from) {
+      char *rel_path = vmake_path_abs_to_rel(module->path);
       printf("  included from %s\n", rel_path);
       free(rel_path);
-      free(str);
     }
 
     gen->state->had_error = true;
@@ -161,10 +226,10 @@ void vmake_string_buf_append(vmake_string_buf *buf, const char *fmt, ...) {
   if (n < 0)
     fprintf(stderr, "An error occurred while trying to append to a string buffer.");
 
-  if (n >= buf->capacity) {
+  if (buf->size + n >= buf->capacity) {
     buf->capacity *= 2;
-    if (n >= buf->capacity) {
-      buf->capacity = n + 1; // + 1 for null terminating byte
+    if (buf->size + n >= buf->capacity) {
+      buf->capacity = buf->size + n + 1; // + 1 for null terminating byte
     }
 
     buf->string = realloc(buf->string, buf->capacity);
@@ -0,0 +1,594 @@
+#include "vm.h"
+#include "array.h"
+#include "file.h"
+#include "gc.h"
+#include "object.h"
+#include "table.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void run(vmake_vm *vm);
+// Reports an error at the token of the byte `offset` bytes into the current instruction, and exits.
+static void runtime_error(vmake_vm *vm, int offset, const char *fmt, ...);
+
+static void grow_stack(vmake_vm *vm);
+static void push(vmake_vm *vm, vmake_value val);
+static vmake_value pop(vmake_vm *vm);
+static vmake_value peek(vmake_vm *vm, int distance);
+
+// Returns the element of `target` at `index`. If it's going to be modified, the array stops sharing
+// its elements first.
+static vmake_value *array_element(vmake_vm *vm, vmake_value target, vmake_value index,
+                                  bool modify);
+static vmake_value table_entry(vmake_vm *vm, vmake_value target, vmake_value key);
+static vmake_obj_instance *expect_instance(vmake_vm *vm, vmake_value val);
+static void invalid_property(vmake_vm *vm, vmake_obj_instance *inst, vmake_value name);
+static bool find_property(vmake_obj_instance *inst, vmake_value name, vmake_inline_cache *cache);
+static void call_value(vmake_vm *vm, int argc, int kwargc, bool has_receiver);
+static void bind_arguments(vmake_vm *vm, vmake_value *callee, const vmake_signature *sig,
+                           vmake_value *args_start, int argc, int kwargc, vmake_arguments *args);
+static void check_argument(vmake_vm *vm, const vmake_param *param, vmake_value val);
+static char *describe_callee(vmake_value *callee);
+static bool is_text(vmake_value val);
+static vmake_value concatenate(vmake_vm *vm, vmake_value lhs, vmake_value rhs);
+static vmake_value flatten(vmake_vm *vm, vmake_value val);
+static void include(vmake_vm *vm, vmake_value val, bool once);
+
+void vmake_vm_run(vmake_gen *gen) {
+  vmake_vm vm;
+  vm.gen = gen;
+  vm.enclosing = gen->state->vm;
+  vm.chunk = gen->chunk;
+  vm.ip = gen->chunk->code;
+  vm.instruction = vm.ip;
+  vm.stack = malloc(sizeof(vmake_value) * VMAKE_STACK_INITIAL_SIZE);
+  vm.stack_top = vm.stack;
+  vm.stack_end = vm.stack + VMAKE_STACK_INITIAL_SIZE;
+  // The caches outlive the run, so a chunk that's included again starts with warm caches.
+  if (gen->chunk->caches == NULL && gen->chunk->cache_count > 0)
+    gen->chunk->caches = calloc(gen->chunk->cache_count, sizeof(vmake_inline_cache));
+
+  // Resolve every global once, so that accessing one is an index into the global values.
+  vm.global_slots = malloc(sizeof(int) * gen->chunk->globals.size);
+  for (int i = 0; i < gen->chunk->globals.size; i++) {
+    vm.global_slots[i] = vmake_global_slot(gen->state, gen->chunk->globals.values[i]);
+  }
+
+  gen->state->vm = &vm;
+  run(&vm);
+  gen->state->vm = vm.enclosing;
+  free(vm.global_slots);
+  free(vm.stack);
+}
+
+static void run(vmake_vm *vm) {
+#define READ_BYTE() (*vm->ip++)
+#define READ_SHORT() (vm->ip += 2, (uint16_t)(vm->ip[-2] << 8 | vm->ip[-1]))
+#define READ_INDEX() (vm->ip += 3, vm->ip[-3] << 16 | vm->ip[-2] << 8 | vm->ip[-1])
+#define READ_CONSTANT() (vm->chunk->constants.values[READ_INDEX()])
+#define READ_CACHE() (&vm->chunk->caches[READ_INDEX()])
+#define GLOBAL() (vm->gen->state->global_values.values[vm->global_slots[READ_INDEX()]])
+#define BINARY_NUMBER_OP(make, op, message)                                                        \
+  do {                                                                                             \
+    vmake_value rhs = pop(vm);                                                                     \
+    vmake_value lhs = pop(vm);                                                                     \
+    if (!vmake_value_is_number(lhs) || !vmake_value_is_number(rhs))                                \
+      runtime_error(vm, 0, message);                                                               \
+    push(vm, make(vmake_value_as_number(lhs) op vmake_value_as_number(rhs)));                      \
+  } while (false)
+
+// With GCC and Clang we use computed gotos, which give every instruction its own indirect branch
+// instead of sharing the one of the switch, and let us skip the bounds check on the opcode.
+#ifdef __GNUC__
+  static void *dispatch_table[] = {
+      [OP_CONSTANT] = &&do_OP_CONSTANT,
+      [OP_NIL] = &&do_OP_NIL,
+      [OP_TRUE] = &&do_OP_TRUE,
+      [OP_FALSE] = &&do_OP_FALSE,
+      [OP_POP] = &&do_OP_POP,
+      [OP_GET_GLOBAL] = &&do_OP_GET_GLOBAL,
+      [OP_SET_GLOBAL] = &&do_OP_SET_GLOBAL,
+      [OP_GET_LOCAL] = &&do_OP_GET_LOCAL,
+      [OP_SET_LOCAL] = &&do_OP_SET_LOCAL,
+      [OP_GET_INDEX] = &&do_OP_GET_INDEX,
+      [OP_SET_INDEX] = &&do_OP_SET_INDEX,
+      [OP_GET_PROPERTY] = &&do_OP_GET_PROPERTY,
+      [OP_GET_METHOD] = &&do_OP_GET_METHOD,
+      [OP_CALL] = &&do_OP_CALL,
+      [OP_INVOKE] = &&do_OP_INVOKE,
+      [OP_ARRAY] = &&do_OP_ARRAY,
+      [OP_APPEND] = &&do_OP_APPEND,
+      [OP_EQUAL] = &&do_OP_EQUAL,
+      [OP_LESS] = &&do_OP_LESS,
+      [OP_LESS_EQUAL] = &&do_OP_LESS_EQUAL,
+      [OP_GREATER] = &&do_OP_GREATER,
+      [OP_GREATER_EQUAL] = &&do_OP_GREATER_EQUAL,
+      [OP_ADD] = &&do_OP_ADD,
+      [OP_SUBTRACT] = &&do_OP_SUBTRACT,
+      [OP_MULTIPLY] = &&do_OP_MULTIPLY,
+      [OP_DIVIDE] = &&do_OP_DIVIDE,
+      [OP_NOT] = &&do_OP_NOT,
+      [OP_NEGATE] = &&do_OP_NEGATE,
+      [OP_PRINT] = &&do_OP_PRINT,
+      [OP_INCLUDE] = &&do_OP_INCLUDE,
+      [OP_INCLUDE_ONCE] = &&do_OP_INCLUDE_ONCE,
+      [OP_RETURN] = &&do_OP_RETURN,
+  };
+#define DISPATCH() goto *dispatch_table[*(vm->instruction = vm->ip)]
+#define TARGET(op) do_##op : vm->ip++;
+#define END_DISPATCH()
+  DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define TARGET(op) case op:
+#define END_DISPATCH() }
+dispatch:
+  vm->instruction = vm->ip;
+  switch (READ_BYTE()) {
+#endif
+
+  TARGET(OP_CONSTANT) {
+    push(vm, READ_CONSTANT());
+    DISPATCH();
+  }
+  TARGET(OP_NIL) {
+    push(vm, vmake_value_nil());
+    DISPATCH();
+  }
+  TARGET(OP_TRUE) {
+    push(vm, vmake_value_bool(true));
+    DISPATCH();
+  }
+  TARGET(OP_FALSE) {
+    push(vm, vmake_value_bool(false));
+    DISPATCH();
+  }
+  TARGET(OP_POP) {
+    pop(vm);
+    DISPATCH();
+  }
+  TARGET(OP_GET_GLOBAL) {
+    push(vm, GLOBAL());
+    DISPATCH();
+  }
+  TARGET(OP_SET_GLOBAL) {
+    GLOBAL() = peek(vm, 0);
+    DISPATCH();
+  }
+  TARGET(OP_GET_LOCAL) {
+    // The file isn't a function, so its locals start at the bottom of the stack.
+    push(vm, vm->stack[READ_BYTE()]);
+    DISPATCH();
+  }
+  TARGET(OP_SET_LOCAL) {
+    vm->stack[READ_BYTE()] = peek(vm, 0);
+    DISPATCH();
+  }
+  TARGET(OP_GET_INDEX) {
+    vmake_value index = pop(vm);
+    vmake_value target = pop(vm);
+    if (vmake_value_is_table(target))
+      push(vm, table_entry(vm, target, flatten(vm, index)));
+    else
+      push(vm, *array_element(vm, target, index, false));
+    DISPATCH();
+  }
+  TARGET(OP_SET_INDEX) {
+    vmake_value val = flatten(vm, pop(vm));
+    vmake_value index = pop(vm);
+    vmake_value target = pop(vm);
+    *array_element(vm, target, index, true) = val;
+    push(vm, val);
+    DISPATCH();
+  }
+  TARGET(OP_GET_PROPERTY) {
+    vmake_value name = READ_CONSTANT();
+    vmake_inline_cache *cache = READ_CACHE();
+    vmake_obj_instance *inst = expect_instance(vm, pop(vm));
+    if (inst->shape != cache->shape && !find_property(inst, name, cache))
+      invalid_property(vm, inst, name);
+    // Disallow storing methods as variables so we don't have to deal with closures and stuff like
+    // that.
+    if (cache->slot == -1)
+      runtime_error(vm, 1, "Expected method call.");
+    push(vm, inst->fields[cache->slot]);
+    DISPATCH();
+  }
+  TARGET(OP_GET_METHOD) {
+    vmake_value name = READ_CONSTANT();
+    vmake_inline_cache *cache = READ_CACHE();
+    vmake_value receiver = pop(vm);
+    vmake_obj_instance *inst = expect_instance(vm, receiver);
+    if (inst->shape != cache->shape && !find_property(inst, name, cache))
+      invalid_property(vm, inst, name);
+    if (cache->slot == -1) {
+      push(vm, cache->method);
+      push(vm, receiver);
+    } else {
+      push(vm, inst->fields[cache->slot]);
+      push(vm, vmake_value_empty());
+    }
+    DISPATCH();
+  }
+  TARGET(OP_CALL) {
+    int argc = READ_BYTE();
+    int kwargc = READ_BYTE();
+    call_value(vm, argc, kwargc, false);
+    vmake_gc_safepoint(vm->gen->state);
+    DISPATCH();
+  }
+  TARGET(OP_INVOKE) {
+    int argc = READ_BYTE();
+    int kwargc = READ_BYTE();
+    call_value(vm, argc, kwargc, true);
+    vmake_gc_safepoint(vm->gen->state);
+    DISPATCH();
+  }
+  TARGET(OP_ARRAY) {
+    vmake_value_array arr;
+    vmake_value_array_new(&arr);
+    vmake_value_array_reserve(&arr, READ_SHORT());
+    push(vm, vmake_value_obj((vmake_obj *)vmake_obj_array_new(vm->gen->state, arr)));
+    DISPATCH();
+  }
+  TARGET(OP_APPEND) {
+    vmake_value val = flatten(vm, pop(vm));
+    vmake_obj_array *arr = (vmake_obj_array *)vmake_value_as_obj(peek(vm, 0));
+    vmake_obj_array_push(vm->gen->state, arr, val);
+    // The array is still on the stack, so large array literals can trigger collections.
+    vmake_gc_safepoint(vm->gen->state);
+    DISPATCH();
+  }
+  TARGET(OP_EQUAL) {
+    vmake_value rhs = flatten(vm, pop(vm));
+    vmake_value lhs = flatten(vm, pop(vm));
+    push(vm, vmake_value_bool(vmake_value_equals(lhs, rhs)));
+    DISPATCH();
+  }
+  TARGET(OP_LESS) {
+    BINARY_NUMBER_OP(vmake_value_bool, <, "Expected numbers for comparison operation.");
+    DISPATCH();
+  }
+  TARGET(OP_LESS_EQUAL) {
+    BINARY_NUMBER_OP(vmake_value_bool, <=, "Expected numbers for comparison operation.");
+    DISPATCH();
+  }
+  TARGET(OP_GREATER) {
+    BINARY_NUMBER_OP(vmake_value_bool, >, "Expected numbers for comparison operation.");
+    DISPATCH();
+  }
+  TARGET(OP_GREATER_EQUAL) {
+    BINARY_NUMBER_OP(vmake_value_bool, >=, "Expected numbers for comparison operation.");
+    DISPATCH();
+  }
+  TARGET(OP_ADD) {
+    vmake_value rhs = pop(vm);
+    vmake_value lhs = pop(vm);
+    if (vmake_value_is_number(lhs) && vmake_value_is_number(rhs)) {
+      push(vm, vmake_value_number(vmake_value_as_number(lhs) + vmake_value_as_number(rhs)));
+    } else if (is_text(lhs) && is_text(rhs)) {
+      push(vm, concatenate(vm, lhs, rhs));
+      vmake_gc_safepoint(vm->gen->state);
+    } else {
+      runtime_error(vm, 0, "Expected numbers or strings for addition.");
+    }
+    DISPATCH();
+  }
+  TARGET(OP_SUBTRACT) {
+    BINARY_NUMBER_OP(vmake_value_number, -, "Expected numbers for subtraction.");
+    DISPATCH();
+  }
+  TARGET(OP_MULTIPLY) {
+    BINARY_NUMBER_OP(vmake_value_number, *, "Expected numbers for multiplication or division.");
+    DISPATCH();
+  }
+  TARGET(OP_DIVIDE) {
+    BINARY_NUMBER_OP(vmake_value_number, /, "Expected numbers for multiplication or division.");
+    DISPATCH();
+  }
+  TARGET(OP_NOT) {
+    vmake_value val = pop(vm);
+    if (!vmake_value_is_bool(val))
+      runtime_error(vm, 0, "Expected boolean for logical not.");
+    push(vm, vmake_value_bool(!vmake_value_as_bool(val)));
+    DISPATCH();
+  }
+  TARGET(OP_NEGATE) {
+    vmake_value val = pop(vm);
+    if (!vmake_value_is_number(val))
+      runtime_error(vm, 0, "Expected number for unary minus.");
+    push(vm, vmake_value_number(-vmake_value_as_number(val)));
+    DISPATCH();
+  }
+  TARGET(OP_PRINT) {
+    vmake_value_print(flatten(vm, pop(vm)));
+    printf("\n");
+    DISPATCH();
+  }
+  TARGET(OP_INCLUDE) {
+    include(vm, flatten(vm, pop(vm)), false);
+    DISPATCH();
+  }
+  TARGET(OP_INCLUDE_ONCE) {
+    include(vm, flatten(vm, pop(vm)), true);
+    DISPATCH();
+  }
+  TARGET(OP_RETURN) { return; }
+  END_DISPATCH()
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_INDEX
+#undef READ_CONSTANT
+#undef READ_CACHE
+#undef GLOBAL
+#undef BINARY_NUMBER_OP
+#undef DISPATCH
+#undef TARGET
+#undef END_DISPATCH
+}
+
+static void runtime_error(vmake_vm *vm, int offset, const char *fmt, ...) {
+  int index = vm->chunk->tokens[vm->instruction - vm->chunk->code + offset];
+  vmake_token token = vmake_token_buffer_get(vm->gen->tokens, index);
+
+  va_list va;
+  va_start(va, fmt);
+  vmake_verror(vm->gen, CTX_USER, &token, fmt, va);
+  va_end(va);
+  exit(1);
+}
+
+static void grow_stack(vmake_vm *vm) {
+  size_t size = vm->stack_top - vm->stack;
+  size_t capacity = (vm->stack_end - vm->stack) * VMAKE_STACK_GROW_FACTOR;
+  vm->stack = reallocarray(vm->stack, capacity, sizeof(vmake_value));
+  vm->stack_top = vm->stack + size;
+  vm->stack_end = vm->stack + capacity;
+}
+
+static void push(vmake_vm *vm, vmake_value val) {
+  if (vm->stack_top == vm->stack_end)
+    grow_stack(vm);
+  *vm->stack_top++ = val;
+}
+
+static vmake_value pop(vmake_vm *vm) { return *--vm->stack_top; }
+
+static vmake_value peek(vmake_vm *vm, int distance) { return vm->stack_top[-1 - distance]; }
+
+static vmake_value *array_element(vmake_vm *vm, vmake_value target, vmake_value index,
+                                  bool modify) {
+  if (!vmake_value_is_number(index)) {
+    runtime_error(vm, 0, "Expected number for array subscript, found %s instead.",
+                  vmake_value_to_string(index));
+  }
+
+  double number = vmake_value_as_number(index);
+  if (trunc(number) != number || number < 0 || number > SIZE_MAX) {
+    runtime_error(vm, 0, "Invalid number for array subscript %s.", vmake_value_to_string(index));
+  }
+
+  if (!vmake_value_is_array(target)) {
+    runtime_error(vm, 0, "Expected array as subscript target, found %s instead.",
+                  vmake_value_to_string(target));
+  }
+
+  vmake_obj_array *obj = (vmake_obj_array *)vmake_value_as_obj(target);
+  size_t i = number;
+  if (i >= (size_t)vmake_obj_array_values(obj)->size) {
+    runtime_error(vm, 0, "Array subscript index %zu is too big for array of size %i.", i,
+                  vmake_obj_array_values(obj)->size);
+  }
+
+  if (modify)
+    return vmake_obj_array_mut(vm->gen->state, obj)->values + i;
+  return vmake_obj_array_values(obj)->values + i;
+}
+
+// Tables can only be read, since the ones scripts get are copies, like get_properties() results.
+static vmake_value table_entry(vmake_vm *vm, vmake_value target, vmake_value key) {
+  vmake_table *table = vmake_obj_table_entries((vmake_obj_table *)vmake_value_as_obj(target));
+  vmake_value *value;
+  if (!vmake_table_get(table, key, &value)) {
+    char *key_string = vmake_value_to_string(key);
+    runtime_error(vm, 0, "Table has no key %s.", key_string);
+  }
+  return *value;
+}
+
+static vmake_obj_instance *expect_instance(vmake_vm *vm, vmake_value val) {
+  if (!vmake_value_is_instance(val)) {
+    runtime_error(vm, 0, "Expected instance for property access, but found %s instead.",
+                  vmake_value_is_obj(val) ? vmake_obj_type_to_string(vmake_value_as_obj(val)->type)
+                                      : vmake_value_type_to_string(vmake_value_get_type(val)));
+  }
+  return (vmake_obj_instance *)vmake_value_as_obj(val);
+}
+
+static void invalid_property(vmake_vm *vm, vmake_obj_instance *inst, vmake_value name) {
+  char *prop_str = vmake_value_to_string(name);
+  char *class_str = vmake_obj_to_string((vmake_obj *)inst->klass->name);
+  runtime_error(vm, 0, "Invalid property %s on instance of %s.", prop_str, class_str);
+}
+
+// The slow path of property accesses, which looks the property up and fills `cache` with where it
+// was found.
+static bool find_property(vmake_obj_instance *inst, vmake_value name, vmake_inline_cache *cache) {
+  int slot = vmake_obj_shape_find(inst->shape, (vmake_obj_string *)vmake_value_as_obj(name));
+  vmake_value *method = NULL;
+  if (slot == -1 && !vmake_table_get(&inst->klass->methods, name, &method))
+    return false;
+  // Shapes belong to a single class, so the shape also tells which methods the instance has.
+  cache->shape = inst->shape;
+  cache->slot = slot;
+  cache->method = slot == -1 ? *method : vmake_value_empty();
+  return true;
+}
+
+static void call_value(vmake_vm *vm, int argc, int kwargc, bool has_receiver) {
+  vmake_value *args_start = vm->stack_top - argc - 2 * kwargc;
+  vmake_value *callee = args_start - (has_receiver ? 2 : 1);
+
+  vmake_arguments args;
+  vmake_value result = vmake_value_nil();
+  if (has_receiver && !vmake_value_is_empty(callee[1])) {
+    vmake_obj_method *method = (vmake_obj_method *)vmake_value_as_obj(*callee);
+    bind_arguments(vm, callee, &method->signature, args_start, argc, kwargc, &args);
+    result = method->method((vmake_obj_instance *)vmake_value_as_obj(callee[1]), vm->gen, &args);
+  } else if (vmake_value_is_native(*callee)) {
+    vmake_obj_native *native = (vmake_obj_native *)vmake_value_as_obj(*callee);
+    bind_arguments(vm, callee, &native->signature, args_start, argc, kwargc, &args);
+    result = native->function(vm->gen, &args);
+  } else {
+    runtime_error(vm, 1, "Object is not callable.");
+  }
+
+  vm->stack_top = callee;
+  push(vm, result);
+}
+
+static void bind_arguments(vmake_vm *vm, vmake_value *callee, const vmake_signature *sig,
+                           vmake_value *args_start, int argc, int kwargc, vmake_arguments *args) {
+  if (argc > sig->positional) {
+    runtime_error(vm, 0, "Expected %i positional arguments for %s but found %i instead.",
+                  sig->positional, describe_callee(callee), argc);
+  }
+
+  uint32_t bound = 0;
+  for (int i = 0; i < argc; i++) {
+    args->slots[i] = flatten(vm, args_start[i]);
+    bound |= 1u << i;
+  }
+
+  // Keyword names are interned constants, and so are the parameter names of the signature.
+  vmake_value *kwargs_end = args_start + argc + 2 * kwargc;
+  for (vmake_value *kwarg = args_start + argc; kwarg < kwargs_end; kwarg += 2) {
+    int i = 0;
+    while (i < sig->count && vmake_value_as_obj(kwarg[0]) != (vmake_obj *)sig->names[i])
+      i++;
+    if (i == sig->count) {
+      runtime_error(vm, 0, "Unexpected keyword argument %s for %s.",
+                    vmake_value_to_string(kwarg[0]), describe_callee(callee));
+    }
+    if (bound & (1u << i)) {
+      runtime_error(vm, 0, "Argument %s was passed more than once to %s.",
+                    vmake_value_to_string(kwarg[0]), describe_callee(callee));
+    }
+    args->slots[i] = flatten(vm, kwarg[1]);
+    bound |= 1u << i;
+  }
+
+  for (int i = 0; i < sig->count; i++) {
+    const vmake_param *param = sig->params + i;
+    if (bound & (1u << i)) {
+      check_argument(vm, param, args->slots[i]);
+    } else if (param->optional) {
+      args->slots[i] = vmake_value_nil();
+    } else if (!param->keyword_only) {
+      runtime_error(vm, 0, "Expected %i positional arguments for %s but found %i instead.",
+                    sig->positional, describe_callee(callee), argc);
+    } else {
+      runtime_error(vm, 0, "Missing keyword argument \"%s\" for %s.", sig->names[i]->chars,
+                    describe_callee(callee));
+    }
+  }
+}
+
+static void check_argument(vmake_vm *vm, const vmake_param *param, vmake_value val) {
+  static const vmake_obj_type obj_types[] = {
+      [PARAM_STRING] = OBJ_STRING,
+      [PARAM_ARRAY] = OBJ_ARRAY,
+      [PARAM_INSTANCE] = OBJ_INSTANCE,
+  };
+  if (param->type == PARAM_ANY ||
+      (vmake_value_is_obj(val) && vmake_value_as_obj(val)->type == obj_types[param->type]))
+    return;
+  vmake_error_exit(vm->gen, CTX_NATIVE, NULL, "Expected %s but found %s instead.",
+                   vmake_param_type_to_string(param->type),
+                   vmake_value_is_obj(val) ? vmake_obj_type_to_string(vmake_value_as_obj(val)->type)
+                                       : vmake_value_type_to_string(vmake_value_get_type(val)));
+}
+
+static char *describe_callee(vmake_value *callee) {
+  char *name = vmake_obj_to_string(vmake_value_as_obj(*callee));
+  if (vmake_value_as_obj(*callee)->type != OBJ_METHOD)
+    return name;
+
+  vmake_obj_instance *inst = (vmake_obj_instance *)vmake_value_as_obj(callee[1]);
+  char *class_name = vmake_obj_to_string((vmake_obj *)inst->klass);
+  size_t size = sizeof("method  of class ") + strlen(name) + strlen(class_name);
+  char *buf = malloc(size);
+  snprintf(buf, size, "method %s of class %s", name, class_name);
+  free(name);
+  free(class_name);
+  return buf;
+}
+
+static bool is_text(vmake_value val) {
+  if (!vmake_value_is_obj(val))
+    return false;
+  vmake_obj_type type = vmake_value_as_obj(val)->type;
+  return type == OBJ_STRING || type == OBJ_ROPE;
+}
+
+static vmake_value concatenate(vmake_vm *vm, vmake_value lhs, vmake_value rhs) {
+  vmake_obj *left = vmake_value_as_obj(lhs);
+  vmake_obj *right = vmake_value_as_obj(rhs);
+  // Concatenating an empty string doesn't need a new rope.
+  if (left->type == OBJ_STRING && ((vmake_obj_string *)left)->length == 0)
+    return rhs;
+  if (right->type == OBJ_STRING && ((vmake_obj_string *)right)->length == 0)
+    return lhs;
+  return vmake_value_obj((vmake_obj *)vmake_obj_rope_new(vm->gen->state, left, right));
+}
+
+static vmake_value flatten(vmake_vm *vm, vmake_value val) {
+  if (!vmake_value_is_obj(val) || vmake_value_as_obj(val)->type != OBJ_ROPE)
+    return val;
+  vmake_obj_rope *rope = (vmake_obj_rope *)vmake_value_as_obj(val);
+  return vmake_value_obj((vmake_obj *)vmake_obj_rope_flatten(vm->gen->state, rope));
+}
+
+static void include(vmake_vm *vm, vmake_value val, bool once) {
+  if (!vmake_value_is_string(val)) {
+    runtime_error(vm, 0, "Expected string after 'include'");
+  }
+
+  vmake_state *state = vm->gen->state;
+  vmake_module *current = vm->gen->module;
+  vmake_module *module = NULL;
+  vmake_value *index = NULL;
+  if (vmake_table_get(&current->includes, val, &index)) {
+    module = state->modules.modules[(int)vmake_value_as_number(*index)];
+  } else {
+    // The include path is either absolute, or relative to the current path. String literals
+    // borrow their characters from the source, so we need our own NUL-terminated copy.
+    vmake_obj_string *include_str = (vmake_obj_string *)vmake_value_as_obj(val);
+    char *include_path = strndup(include_str->chars, include_str->length);
+    char *resolved_path = vmake_path_rel(vm->gen->file_path, include_path);
+    if (resolved_path != NULL)
+      module = vmake_module_get(&state->modules, resolved_path);
+    if (module == NULL) {
+      runtime_error(vm, 0, "No file with path '%s' was found", include_path);
+    }
+    free(resolved_path);
+    free(include_path);
+    vmake_table_put_cpy(&current->includes, val, vmake_value_number(module->index));
+  }
+
+  // Files that are still running count as run, so files can include_once each other.
+  if (once && (module->active || module->run_count > 0))
+    return;
+  if (module->active) {
+    char *val_str = vmake_value_to_string(val);
+    runtime_error(vm, 0, "Cyclic include detected while including %s", val_str);
+  }
+
+  module->included_from = current;
+  vmake_process_module(state, module);
+  module->included_from = NULL;
+}
@@ -0,0 +1,124 @@
+# Runs a VMake file several times with a build directory, to check that compiled files are cached,
+# that broken cache entries are compiled again, and that the entries of edited files aren't used.
+import os
+import shutil
+import subprocess
+import tempfile
+from sys import argv
+
+RESET = "\033[0m"
+RED = "\033[0;31m"
+GREEN = "\033[0;32m"
+FIXTURE_DIR = os.path.join(os.path.dirname(os.path.realpath(__file__)), "cache", "fixture")
+CACHE_DIRECTORY = ".vmake-cache"
+
+
+class Failure(Exception):
+    pass
+
+
+def run(vmake_executable: str, source_dir: str, build_dir: str) -> str:
+    proc = subprocess.run(
+        [vmake_executable, os.path.join(source_dir, "VMake.vmake"), source_dir, build_dir],
+        capture_output=True,
+        text=True,
+        timeout=5,
+    )
+    if proc.returncode != 0 or len(proc.stderr) > 0:
+        raise Failure(f"vaq-make failed with status {proc.returncode}:\n{proc.stderr}")
+    return proc.stdout
+
+
+def entries(build_dir: str) -> dict[str, os.stat_result]:
+    cache_dir = os.path.join(build_dir, CACHE_DIRECTORY)
+    return {name: os.stat(os.path.join(cache_dir, name)) for name in os.listdir(cache_dir)}
+
+
+def expect(condition: bool, message: str):
+    if not condition:
+        raise Failure(message)
+
+
+def expect_output(found: str, expected: str):
+    expect(found == expected, f"Expected output {expected!r}, found {found!r}")
+
+
+def cached_run(vmake_executable: str, source_dir: str, build_dir: str, expected: str):
+    expect_output(run(vmake_executable, source_dir, build_dir), expected)
+    before = entries(build_dir)
+    expect(len(before) == 2, f"Expected an entry per file, found {sorted(before)}")
+    expect_output(run(vmake_executable, source_dir, build_dir), expected)
+    # Entries are written to a temporary file that replaces the old one, so an entry that was
+    # written again has a new inode.
+    after = entries(build_dir)
+    expect(
+        {name: stat.st_ino for name, stat in after.items()}
+        == {name: stat.st_ino for name, stat in before.items()},
+        "Expected the second run to use the cached entries",
+    )
+
+
+def broken_entries(vmake_executable: str, source_dir: str, build_dir: str, expected: str):
+    run(vmake_executable, source_dir, build_dir)
+    cache_dir = os.path.join(build_dir, CACHE_DIRECTORY)
+    before = entries(build_dir)
+    names = sorted(before)
+    # Truncate one entry and flip a byte in the middle of the other.
+    with open(os.path.join(cache_dir, names[0]), "r+b") as file:
+        file.truncate(before[names[0]].st_size // 2)
+    with open(os.path.join(cache_dir, names[1]), "r+b") as file:
+        file.seek(before[names[1]].st_size // 2)
+        byte = file.read(1)[0]
+        file.seek(-1, os.SEEK_CUR)
+        file.write(bytes([byte ^ 0xFF]))
+
+    expect_output(run(vmake_executable, source_dir, build_dir), expected)
+    after = entries(build_dir)
+    for name in names:
+        expect(after[name].st_ino != before[name].st_ino, f"Expected {name} to be compiled again")
+        expect(after[name].st_size == before[name].st_size, f"Expected {name} to be rewritten")
+
+
+def edited_source(vmake_executable: str, source_dir: str, build_dir: str, expected: str):
+    run(vmake_executable, source_dir, build_dir)
+    before = entries(build_dir)
+    include_path = os.path.join(source_dir, "greeting.inc")
+    with open(include_path) as file:
+        text = file.read()
+    with open(include_path, "w") as file:
+        file.write(text.replace('"hello"', '"goodbye"'))
+
+    edited = expected.replace("hello", "goodbye")
+    expect_output(run(vmake_executable, source_dir, build_dir), edited)
+    after = entries(build_dir)
+    expect(len(after) == len(before) + 1, "Expected a new entry for the edited file")
+
+
+def main():
+    if len(argv) != 2:
+        print(f"Usage: {os.path.relpath(__file__, os.getcwd())} vmake_executable_path")
+        exit(1)
+    vmake_executable = os.path.realpath(argv[1])
+    with open(os.path.join(FIXTURE_DIR, "out")) as file:
+        expected = file.read()
+
+    fails = 0
+    tests = [cached_run, broken_entries, edited_source]
+    for test in tests:
+        with tempfile.TemporaryDirectory() as temp_dir:
+            source_dir = os.path.join(temp_dir, "source")
+            build_dir = os.path.join(temp_dir, "build")
+            shutil.copytree(FIXTURE_DIR, source_dir)
+            os.mkdir(build_dir)
+            try:
+                test(vmake_executable, source_dir, build_dir, expected)
+                print(f"  {GREEN}Test '{test.__name__}' passed{RESET}")
+            except (Failure, subprocess.TimeoutExpired) as failure:
+                print(f"  {RED}Test '{test.__name__}' failed{RESET}: {failure}")
+                fails += 1
+    print(f"Cache: {len(tests) - fails}/{len(tests)} passed")
+    exit(1 if fails > 0 else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,114 @@
+// Generates the perfect hash table used by the scanner to recognize keywords. The keywords are
+// read from keywords.def, and the table is written as a C header to the path given as the only
+// argument.
+
+#include "keyword-hash.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TABLE_BITS 12
+#define SEEDS_PER_SIZE 100000
+
+typedef struct keyword {
+  const char *name;
+  const char *type;
+} keyword;
+
+static const keyword keywords[] = {
+#define VMAKE_KEYWORD(name, type) {name, #type},
+#include "keywords.def"
+#undef VMAKE_KEYWORD
+};
+
+static const int keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+
+static bool is_perfect(uint32_t seed, int bits, int *slots) {
+  int size = 1 << bits;
+  for (int i = 0; i < size; i++)
+    slots[i] = -1;
+
+  for (int i = 0; i < keyword_count; i++) {
+    uint32_t slot =
+        vmake_keyword_hash(keywords[i].name, strlen(keywords[i].name), seed, 32 - bits);
+    if (slots[slot] != -1)
+      return false;
+    slots[slot] = i;
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s [output_header]\n", argv[0]);
+    exit(1);
+  }
+
+  int min_length = 0;
+  int max_length = 0;
+  for (int i = 0; i < keyword_count; i++) {
+    int length = strlen(keywords[i].name);
+    if (i == 0 || length < min_length)
+      min_length = length;
+    if (i == 0 || length > max_length)
+      max_length = length;
+  }
+
+  int bits = 1;
+  while ((1 << bits) < keyword_count)
+    bits++;
+
+  int *slots = malloc(sizeof(int) << MAX_TABLE_BITS);
+  uint32_t seed = 0;
+  bool found = false;
+  for (; bits <= MAX_TABLE_BITS && !found; bits++) {
+    // The seeds come from a fixed LCG so that the output is the same on every build.
+    uint32_t state = 2166136261u;
+    for (int i = 0; i < SEEDS_PER_SIZE; i++) {
+      state = state * 1664525u + 1013904223u;
+      seed = state | 1;
+      if (is_perfect(seed, bits, slots)) {
+        found = true;
+        break;
+      }
+    }
+  }
+  bits--;
+
+  if (!found) {
+    fprintf(stderr,
+            "Could not find a perfect hash for the keywords. Two keywords probably share the same "
+            "first character, last character and length.\n");
+    exit(1);
+  }
+
+  FILE *fp = fopen(argv[1], "w");
+  if (fp == NULL) {
+    fprintf(stderr, "Could not open '%s' for writing.\n", argv[1]);
+    exit(1);
+  }
+
+  fprintf(fp, "// Generated by keyword-gen from keywords.def. Do not edit.\n");
+  fprintf(fp, "#pragma once\n\n");
+  fprintf(fp, "#include \"keyword-hash.h\"\n\n");
+  fprintf(fp, "#define VMAKE_KEYWORD_SEED %uu\n", seed);
+  fprintf(fp, "#define VMAKE_KEYWORD_SHIFT %i\n", 32 - bits);
+  fprintf(fp, "#define VMAKE_KEYWORD_MIN_LENGTH %i\n", min_length);
+  fprintf(fp, "#define VMAKE_KEYWORD_MAX_LENGTH %i\n\n", max_length);
+  fprintf(fp, "static const vmake_keyword vmake_keyword_table[%i] = {\n", 1 << bits);
+  for (int i = 0; i < 1 << bits; i++) {
+    if (slots[i] == -1) {
+      fprintf(fp, "    {\"\", 0, TOKEN_IDENTIFIER},\n");
+    } else {
+      const keyword *kw = &keywords[slots[i]];
+      fprintf(fp, "    {\"%s\", %zu, %s},\n", kw->name, strlen(kw->name), kw->type);
+    }
+  }
+  fprintf(fp, "};\n");
+
+  fclose(fp);
+  free(slots);
+  return 0;
+}